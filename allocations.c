@@ -0,0 +1,128 @@
+#include "allocations.h"
+
+#ifdef TRACK_ALLOCATIONS
+
+#include <SDL2/SDL.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Defining malloc and friends here replaces them for every library in the
+ * process (the executable comes first in symbol lookup), and glibc still
+ * exports the real ones under these names to forward to. Other C libraries
+ * don't, so tracking is glibc only. */
+#ifndef __GLIBC__
+#error "TRACK_ALLOCATIONS needs glibc to replace malloc process wide"
+#endif
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *memory, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *memory);
+
+const char *ALLOCATION_PHASE_NAMES[AllocationPhase_Count] = {
+    "startup", "input", "update", "render", "simulation"};
+
+/* Any thread can allocate (ours, SDL's, the driver's), and it can happen
+ * before main, so these are plain C11 atomics rather than SDL's. The phase
+ * is per thread so the simulation's allocations aren't charged to whatever
+ * the render thread happens to be doing. */
+_Thread_local int allocationPhase;
+atomic_int frameAllocations[AllocationPhase_Count];
+atomic_llong frameBytes[AllocationPhase_Count];
+long long totalAllocations[AllocationPhase_Count];
+long long totalBytes[AllocationPhase_Count];
+long long steadyAllocations[AllocationPhase_Count];
+int allocationFrames = 0;
+int dirtyFrames = 0; /* Frames after warmup that allocated anything */
+
+static void countAllocation(size_t size) {
+    atomic_fetch_add_explicit(&frameAllocations[allocationPhase], 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&frameBytes[allocationPhase], (long long)size,
+                              memory_order_relaxed);
+}
+
+void *malloc(size_t size) {
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *memory, size_t size) {
+    countAllocation(size);
+    return __libc_realloc(memory, size);
+}
+
+void free(void *memory) { __libc_free(memory); }
+
+/* Drivers like aligned memory, these would skip the counters otherwise */
+int posix_memalign(void **memory, size_t alignment, size_t size) {
+    countAllocation(size);
+    *memory = __libc_memalign(alignment, size);
+    return *memory || !size ? 0 : ENOMEM;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    countAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    countAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void startTrackingAllocations() {
+    /* SDL might be built with its own allocator instead of libc's, so point
+     * it at ours as well */
+    SDL_SetMemoryFunctions(malloc, calloc, realloc, free);
+    setAllocationPhase(AllocationPhase_Startup);
+}
+
+void setAllocationPhase(enum AllocationPhase phase) {
+    allocationPhase = phase;
+}
+
+void endAllocationFrame() {
+    int allocations = 0;
+
+    for (int i = 0; i < AllocationPhase_Count; ++i) {
+        int count = atomic_exchange(&frameAllocations[i], 0);
+        long long bytes = atomic_exchange(&frameBytes[i], 0);
+        totalAllocations[i] += count;
+        totalBytes[i] += bytes;
+        if (allocationFrames >= ALLOCATION_WARMUP_FRAMES) {
+            steadyAllocations[i] += count;
+        }
+        allocations += count;
+    }
+
+    if (allocationFrames >= ALLOCATION_WARMUP_FRAMES && allocations > 0) {
+        if (dirtyFrames++ == 0) {
+            printf("Frame %d allocated %d times!\n", allocationFrames,
+                   allocations);
+        }
+    }
+    ++allocationFrames;
+}
+
+int reportAllocations() {
+    printf("Allocations over %d frames (%d warmup):\n", allocationFrames,
+           ALLOCATION_WARMUP_FRAMES);
+    for (int i = 0; i < AllocationPhase_Count; ++i) {
+        printf("  %-10s %8lld allocs %10lld bytes %8lld after warmup\n",
+               ALLOCATION_PHASE_NAMES[i], totalAllocations[i], totalBytes[i],
+               steadyAllocations[i]);
+    }
+    printf("Frames that allocated after warmup: %d\n", dirtyFrames);
+    return dirtyFrames;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef ALLOCATIONS_H
+#define ALLOCATIONS_H
+
+/* Allocation tracking, compile with -DTRACK_ALLOCATIONS (and allocations.c)
+ * to turn it on. malloc and friends are replaced for the whole process, so
+ * SDL, its drivers, FreeType and tetris.c all get counted, not just us. */
+
+enum AllocationPhase {
+    AllocationPhase_Startup,
+    AllocationPhase_Input,
+    AllocationPhase_Update,
+    AllocationPhase_Render,
+    AllocationPhase_Simulation, /* Anything on the simulation thread */
+    AllocationPhase_Count
+};
+
+#ifdef TRACK_ALLOCATIONS
+/* Frames allowed to allocate, after that every frame should be clean */
+#define ALLOCATION_WARMUP_FRAMES 60
+
+void startTrackingAllocations();
+/* Per thread, new threads start out in AllocationPhase_Startup */
+void setAllocationPhase(enum AllocationPhase phase);
+void endAllocationFrame();
+int reportAllocations();
+#else
+#define startTrackingAllocations()
+#define setAllocationPhase(phase)
+#define endAllocationFrame()
+#endif
+
+#endif
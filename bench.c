@@ -0,0 +1,658 @@
+/* Micro-benchmarks for the hot functions in tetris.c */
+/* ./bench [--board WIDTHxHEIGHT] [--seed N] [--json] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tetris.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const int CORPUS_SIZE = 4096;
+const double MIN_SECONDS_PER_BENCHMARK = 0.2;
+
+/* A position from a played game: the board with the falling piece in it */
+typedef struct {
+    Playfield playfield;
+    SDL_Rect pieceBounds;
+    int pieceIndex;
+    int rotationIndex;
+    int currentColor;
+} Snapshot;
+
+typedef struct {
+    Snapshot *snapshots;
+    int count;
+} Corpus;
+
+/* Returns something that depends on the work so it can't be optimized out */
+typedef long long (*BenchFunction)(Snapshot *snapshot);
+
+typedef struct {
+    const char *name;
+    BenchFunction function;
+    const Corpus *corpus;
+    bool mutates; /* Needs a fresh copy of the snapshot for every call */
+} Benchmark;
+
+enum Counter {
+    Counter_Cycles,
+    Counter_Instructions,
+    Counter_BranchMisses,
+    Counter_CacheMisses,
+    Counter_Count
+};
+
+const char *COUNTER_NAMES[Counter_Count] = {"cycles", "instructions",
+                                            "branch_misses", "cache_misses"};
+
+typedef struct {
+    double nsPerOp;
+    double perOp[Counter_Count]; /* Negative if the counter isn't available */
+} Result;
+
+/* Corpus */
+bool createSnapshot(Snapshot *snapshot, int width, int visibleHeight);
+void copySnapshot(Snapshot *destination, const Snapshot *source);
+bool addSnapshot(Corpus *corpus, const Snapshot *snapshot, int capacity);
+void destroyCorpus(Corpus *corpus);
+bool rotationFits(const Snapshot *snapshot);
+int findBestPlacement(const Snapshot *snapshot, Snapshot *scratch,
+                      int *bestShift);
+void harvestCorpus(Corpus *corpus, int width, int visibleHeight, int size);
+void filterCorpus(Corpus *filtered, const Corpus *corpus,
+                  bool (*keep)(const Snapshot *snapshot));
+void lockedCorpus(Corpus *locked, const Corpus *corpus, int fullRows);
+
+/* Performance counters */
+void openCounters();
+void startCounters();
+void stopCounters(long long values[Counter_Count]);
+void closeCounters();
+
+/* Running */
+double nowInSeconds();
+Result runBenchmark(const Benchmark *benchmark, Snapshot *scratch);
+double withoutOverhead(double value, double overhead);
+void printResult(const char *name, Result result, bool json, bool first);
+
+/* The benchmarks */
+long long benchRestoreOnly(Snapshot *snapshot);
+long long benchCanMoveDown(Snapshot *snapshot);
+long long benchCanMoveLeft(Snapshot *snapshot);
+long long benchCanMoveRight(Snapshot *snapshot);
+long long benchCanRotatePiece(Snapshot *snapshot);
+long long benchRotatePiece(Snapshot *snapshot);
+long long benchDropPieceOneRow(Snapshot *snapshot);
+long long benchConvertPieceToStatic(Snapshot *snapshot);
+long long benchClearEmptyRows(Snapshot *snapshot);
+long long benchSpawnRandomPiece(Snapshot *snapshot);
+bool canRotate(const Snapshot *snapshot);
+bool canDrop(const Snapshot *snapshot);
+
+volatile long long sink;
+
+int main(int argc, char *argv[]) {
+    int boardWidth = PLAYFIELD_WIDTH;
+    int boardHeight = PLAYFIELD_HEIGHT - 1;
+    unsigned int seed = 1;
+    bool json = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--board") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &boardWidth, &boardHeight) != 2 ||
+                boardWidth < MIN_BOARD_WIDTH || boardWidth > MAX_BOARD_WIDTH ||
+                boardHeight < MIN_BOARD_HEIGHT ||
+                boardHeight > MAX_BOARD_HEIGHT) {
+                fprintf(stderr, "Board size must be between %dx%d and %dx%d!\n",
+                        MIN_BOARD_WIDTH, MIN_BOARD_HEIGHT, MAX_BOARD_WIDTH,
+                        MAX_BOARD_HEIGHT);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else {
+            fprintf(stderr,
+                    "Usage: %s [--board WIDTHxHEIGHT] [--seed N] [--json]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    /* Same seed, same games, same corpus, so runs can be compared */
+    srand(seed);
+    Corpus corpus = {NULL, 0};
+    harvestCorpus(&corpus, boardWidth, boardHeight, CORPUS_SIZE);
+
+    Corpus rotatable = {NULL, 0};
+    Corpus droppable = {NULL, 0};
+    Corpus locked[5]; /* Piece locked in, with 0 to 4 full rows */
+    filterCorpus(&rotatable, &corpus, canRotate);
+    filterCorpus(&droppable, &corpus, canDrop);
+    for (int i = 0; i < 5; ++i) {
+        lockedCorpus(&locked[i], &corpus, i);
+    }
+
+    Snapshot scratch;
+    if (!corpus.count || !createSnapshot(&scratch, boardWidth, boardHeight)) {
+        fprintf(stderr, "Couldn't build the corpus!\n");
+        return 1;
+    }
+
+    const Benchmark benchmarks[] = {
+        {"canMoveInDirection/down", benchCanMoveDown, &corpus, false},
+        {"canMoveInDirection/left", benchCanMoveLeft, &corpus, false},
+        {"canMoveInDirection/right", benchCanMoveRight, &corpus, false},
+        {"canRotatePiece", benchCanRotatePiece, &corpus, false},
+        {"rotatePiece", benchRotatePiece, &rotatable, true},
+        {"dropPieceOneRow", benchDropPieceOneRow, &droppable, true},
+        {"convertPieceToStatic", benchConvertPieceToStatic, &corpus, true},
+        {"clearEmptyRows/0", benchClearEmptyRows, &locked[0], true},
+        {"clearEmptyRows/1", benchClearEmptyRows, &locked[1], true},
+        {"clearEmptyRows/2", benchClearEmptyRows, &locked[2], true},
+        {"clearEmptyRows/3", benchClearEmptyRows, &locked[3], true},
+        {"clearEmptyRows/4", benchClearEmptyRows, &locked[4], true},
+        {"spawnRandomPiece", benchSpawnRandomPiece, &locked[0], true},
+    };
+    int benchmarkCount = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+    openCounters();
+
+    if (json) {
+        printf("{\n  \"board\": \"%dx%d\",\n  \"seed\": %u,\n", boardWidth,
+               boardHeight, seed);
+        printf("  \"corpus\": %d,\n  \"benchmarks\": [\n", corpus.count);
+    } else {
+        printf("Board %dx%d, %d positions from seed %u\n\n", boardWidth,
+               boardHeight, corpus.count, seed);
+        printf("%-26s %10s %10s %12s %10s %10s\n", "benchmark", "ns/op",
+               "cycles", "instructions", "br-misses", "$-misses");
+    }
+
+    int printed = 0;
+    for (int i = 0; i < benchmarkCount; ++i) {
+        if (!benchmarks[i].corpus->count) {
+            continue; /* Nothing in the corpus fit, e.g. nothing could drop */
+        }
+        Result result = runBenchmark(&benchmarks[i], &scratch);
+
+        if (benchmarks[i].mutates) {
+            /* Take out the cost of restoring the snapshot every call */
+            Benchmark restore = {"", benchRestoreOnly, benchmarks[i].corpus,
+                                 true};
+            Result overhead = runBenchmark(&restore, &scratch);
+            result.nsPerOp = withoutOverhead(result.nsPerOp, overhead.nsPerOp);
+            for (int j = 0; j < Counter_Count; ++j) {
+                if (result.perOp[j] >= 0 && overhead.perOp[j] >= 0) {
+                    result.perOp[j] =
+                        withoutOverhead(result.perOp[j], overhead.perOp[j]);
+                }
+            }
+        }
+
+        printResult(benchmarks[i].name, result, json, printed++ == 0);
+    }
+
+    if (json) {
+        printf("\n  ]\n}\n");
+    }
+
+    closeCounters();
+    destroyCorpus(&corpus);
+    destroyCorpus(&rotatable);
+    destroyCorpus(&droppable);
+    for (int i = 0; i < 5; ++i) {
+        destroyCorpus(&locked[i]);
+    }
+    destroyPlayfield(&scratch.playfield);
+    return 0;
+}
+
+bool createSnapshot(Snapshot *snapshot, int width, int visibleHeight) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    return createPlayfield(&snapshot->playfield, width, visibleHeight);
+}
+
+void copySnapshot(Snapshot *destination, const Snapshot *source) {
+    /* Both are always the same size */
+    memcpy(destination->playfield.cells, source->playfield.cells,
+           (size_t)source->playfield.width * source->playfield.height *
+               sizeof(int));
+    destination->pieceBounds = source->pieceBounds;
+    destination->pieceIndex = source->pieceIndex;
+    destination->rotationIndex = source->rotationIndex;
+    destination->currentColor = source->currentColor;
+}
+
+bool addSnapshot(Corpus *corpus, const Snapshot *snapshot, int capacity) {
+    if (!corpus->snapshots) {
+        corpus->snapshots = calloc(capacity, sizeof(Snapshot));
+        if (!corpus->snapshots) {
+            return false;
+        }
+    }
+
+    Snapshot *added = &corpus->snapshots[corpus->count];
+    if (!createSnapshot(added, snapshot->playfield.width,
+                        snapshot->playfield.height - 1)) {
+        return false;
+    }
+    copySnapshot(added, snapshot);
+    ++corpus->count;
+    return true;
+}
+
+void destroyCorpus(Corpus *corpus) {
+    for (int i = 0; i < corpus->count; ++i) {
+        destroyPlayfield(&corpus->snapshots[i].playfield);
+    }
+    free(corpus->snapshots);
+    corpus->snapshots = NULL;
+    corpus->count = 0;
+}
+
+bool rotationFits(const Snapshot *snapshot) {
+    /* canRotatePiece only checks the walls, the bot also wants to know it
+     * won't rotate into the stack */
+    const Playfield *playfield = &snapshot->playfield;
+    const int(*rotation)[4] =
+        pieceRotations[snapshot->pieceIndex][(snapshot->rotationIndex + 1) % 4];
+
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            if (!rotation[i][j]) {
+                continue;
+            }
+            int row = snapshot->pieceBounds.y + i;
+            int column = snapshot->pieceBounds.x + j;
+            if (row >= playfield->height || column < 0 ||
+                column >= playfield->width) {
+                return false;
+            }
+            int square = playfield->cells[row * playfield->width + column];
+            if (square != 0 && square != CURRENT_PIECE_NUMBER) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int findBestPlacement(const Snapshot *snapshot, Snapshot *scratch,
+                      int *bestShift) {
+    /* Tries every rotation and column and goes for whichever lands lowest,
+     * which plays well enough to build stacks and clear lines */
+    int bestRotations = 0;
+    int bestLanding = -1;
+    *bestShift = 0;
+
+    for (int rotations = 0; rotations < 4; ++rotations) {
+        for (int shift = -snapshot->playfield.width;
+             shift <= snapshot->playfield.width; ++shift) {
+            copySnapshot(scratch, snapshot);
+
+            bool valid = true;
+            for (int i = 0; i < rotations && valid; ++i) {
+                valid = rotationFits(scratch);
+                if (valid) {
+                    rotatePiece(&scratch->pieceBounds, &scratch->playfield,
+                                scratch->pieceIndex, &scratch->rotationIndex);
+                }
+            }
+
+            enum Direction direction =
+                shift < 0 ? Direction_Left : Direction_Right;
+            for (int i = 0; i < abs(shift) && valid; ++i) {
+                valid = canMoveInDirection(scratch->pieceBounds,
+                                           &scratch->playfield, direction);
+                if (!valid) {
+                    break;
+                }
+                if (direction == Direction_Left) {
+                    movePieceLeft(&scratch->pieceBounds, &scratch->playfield);
+                } else {
+                    movePieceRight(&scratch->pieceBounds, &scratch->playfield);
+                }
+            }
+
+            if (!valid) {
+                continue;
+            }
+
+            int landing = scratch->pieceBounds.y +
+                          getDropDistance(scratch->pieceBounds,
+                                          &scratch->playfield);
+            if (landing > bestLanding ||
+                (landing == bestLanding && rand() % 2)) {
+                bestLanding = landing;
+                bestRotations = rotations;
+                *bestShift = shift;
+            }
+        }
+    }
+
+    return bestRotations;
+}
+
+void harvestCorpus(Corpus *corpus, int width, int visibleHeight, int size) {
+    /* Plays bot games and keeps every position the falling piece passes
+     * through, so the corpus has the same mix of empty, messy and nearly full
+     * boards as a real game */
+    Snapshot game;
+    Snapshot scratch;
+    if (!createSnapshot(&game, width, visibleHeight) ||
+        !createSnapshot(&scratch, width, visibleHeight)) {
+        return;
+    }
+
+    while (corpus->count < size) {
+        if (!spawnRandomPiece(&game.playfield, &game.pieceBounds,
+                              &game.currentColor, &game.pieceIndex)) {
+            /* Game over, start another one */
+            memset(game.playfield.cells, 0,
+                   (size_t)width * game.playfield.height * sizeof(int));
+            continue;
+        }
+        game.rotationIndex = 0;
+
+        int shift;
+        int rotations = findBestPlacement(&game, &scratch, &shift);
+
+        for (int i = 0; i < rotations && corpus->count < size; ++i) {
+            addSnapshot(corpus, &game, size);
+            rotatePiece(&game.pieceBounds, &game.playfield, game.pieceIndex,
+                        &game.rotationIndex);
+        }
+        for (int i = 0; i < abs(shift) && corpus->count < size; ++i) {
+            addSnapshot(corpus, &game, size);
+            if (shift < 0) {
+                movePieceLeft(&game.pieceBounds, &game.playfield);
+            } else {
+                movePieceRight(&game.pieceBounds, &game.playfield);
+            }
+        }
+        while (corpus->count < size) {
+            addSnapshot(corpus, &game, size);
+            if (!canMoveInDirection(game.pieceBounds, &game.playfield,
+                                    Direction_Down)) {
+                break;
+            }
+            dropPieceOneRow(&game.pieceBounds, &game.playfield);
+        }
+
+        convertPieceToStatic(game.pieceBounds, &game.playfield,
+                             game.currentColor);
+        clearEmptyRows(&game.playfield);
+    }
+
+    destroyPlayfield(&game.playfield);
+    destroyPlayfield(&scratch.playfield);
+}
+
+void filterCorpus(Corpus *filtered, const Corpus *corpus,
+                  bool (*keep)(const Snapshot *snapshot)) {
+    filtered->snapshots = NULL;
+    filtered->count = 0;
+
+    for (int i = 0; i < corpus->count; ++i) {
+        if (keep(&corpus->snapshots[i])) {
+            addSnapshot(filtered, &corpus->snapshots[i], corpus->count);
+        }
+    }
+}
+
+void lockedCorpus(Corpus *locked, const Corpus *corpus, int fullRows) {
+    /* Every position with its piece locked in, any rows it completed cleared
+     * and then exactly fullRows of the bottom rows filled in */
+    locked->snapshots = NULL;
+    locked->count = 0;
+    if (!corpus->count) {
+        return;
+    }
+
+    Snapshot scratch;
+    const Playfield *first = &corpus->snapshots[0].playfield;
+    if (!createSnapshot(&scratch, first->width, first->height - 1)) {
+        return;
+    }
+    Playfield *playfield = &scratch.playfield;
+
+    for (int i = 0; i < corpus->count; ++i) {
+        copySnapshot(&scratch, &corpus->snapshots[i]);
+        convertPieceToStatic(scratch.pieceBounds, playfield,
+                             scratch.currentColor);
+        clearEmptyRows(playfield);
+
+        for (int row = playfield->height - fullRows; row < playfield->height;
+             ++row) {
+            for (int j = 0; j < playfield->width; ++j) {
+                playfield->cells[row * playfield->width + j] = 1;
+            }
+        }
+
+        addSnapshot(locked, &scratch, corpus->count);
+    }
+
+    destroyPlayfield(&scratch.playfield);
+}
+
+#ifdef __linux__
+int counterFds[Counter_Count];
+
+void openCounters() {
+    const unsigned long long configs[Counter_Count] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+
+    for (int i = 0; i < Counter_Count; ++i) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        /* -1 if this machine (or VM, or container) won't give it to us */
+        counterFds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+void startCounters() {
+    for (int i = 0; i < Counter_Count; ++i) {
+        if (counterFds[i] >= 0) {
+            ioctl(counterFds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counterFds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void stopCounters(long long values[Counter_Count]) {
+    for (int i = 0; i < Counter_Count; ++i) {
+        values[i] = -1;
+        if (counterFds[i] < 0) {
+            continue;
+        }
+
+        ioctl(counterFds[i], PERF_EVENT_IOC_DISABLE, 0);
+        unsigned long long value;
+        if (read(counterFds[i], &value, sizeof(value)) == sizeof(value)) {
+            values[i] = value;
+        }
+    }
+}
+
+void closeCounters() {
+    for (int i = 0; i < Counter_Count; ++i) {
+        if (counterFds[i] >= 0) {
+            close(counterFds[i]);
+        }
+    }
+}
+#else
+/* No perf_event_open, so only timings */
+void openCounters() {}
+void startCounters() {}
+void stopCounters(long long values[Counter_Count]) {
+    for (int i = 0; i < Counter_Count; ++i) {
+        values[i] = -1;
+    }
+}
+void closeCounters() {}
+#endif
+
+double nowInSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+Result runBenchmark(const Benchmark *benchmark, Snapshot *scratch) {
+    const Corpus *corpus = benchmark->corpus;
+    long long total = 0;
+
+    /* One pass to warm the caches and the branch predictors */
+    for (int i = 0; i < corpus->count; ++i) {
+        Snapshot *snapshot = &corpus->snapshots[i];
+        if (benchmark->mutates) {
+            copySnapshot(scratch, snapshot);
+            snapshot = scratch;
+        }
+        total += benchmark->function(snapshot);
+    }
+
+    long long operations = 0;
+    long long counters[Counter_Count];
+    double start = nowInSeconds();
+    double elapsed = 0;
+    startCounters();
+
+    /* Whole passes over the corpus until enough time has gone by */
+    while (elapsed < MIN_SECONDS_PER_BENCHMARK) {
+        for (int i = 0; i < corpus->count; ++i) {
+            Snapshot *snapshot = &corpus->snapshots[i];
+            if (benchmark->mutates) {
+                copySnapshot(scratch, snapshot);
+                snapshot = scratch;
+            }
+            total += benchmark->function(snapshot);
+        }
+        operations += corpus->count;
+        elapsed = nowInSeconds() - start;
+    }
+
+    stopCounters(counters);
+    sink += total;
+
+    Result result;
+    result.nsPerOp = elapsed * 1e9 / operations;
+    for (int i = 0; i < Counter_Count; ++i) {
+        result.perOp[i] =
+            counters[i] >= 0 ? (double)counters[i] / operations : -1;
+    }
+    return result;
+}
+
+double withoutOverhead(double value, double overhead) {
+    /* Noise can put the overhead above a very cheap function */
+    return value > overhead ? value - overhead : 0;
+}
+
+void printResult(const char *name, Result result, bool json, bool first) {
+    if (json) {
+        printf("%s    {\"name\": \"%s\", \"ns_per_op\": %.3f",
+               first ? "" : ",\n", name, result.nsPerOp);
+        for (int i = 0; i < Counter_Count; ++i) {
+            if (result.perOp[i] >= 0) {
+                printf(", \"%s\": %.3f", COUNTER_NAMES[i], result.perOp[i]);
+            } else {
+                printf(", \"%s\": null", COUNTER_NAMES[i]);
+            }
+        }
+        printf("}");
+        return;
+    }
+
+    printf("%-26s %10.2f", name, result.nsPerOp);
+    const int columnWidths[Counter_Count] = {10, 12, 10, 10};
+    for (int i = 0; i < Counter_Count; ++i) {
+        if (result.perOp[i] >= 0) {
+            printf(" %*.2f", columnWidths[i], result.perOp[i]);
+        } else {
+            printf(" %*s", columnWidths[i], "n/a");
+        }
+    }
+    printf("\n");
+}
+
+long long benchRestoreOnly(Snapshot *snapshot) {
+    return snapshot->pieceBounds.y;
+}
+
+long long benchCanMoveDown(Snapshot *snapshot) {
+    return canMoveInDirection(snapshot->pieceBounds, &snapshot->playfield,
+                              Direction_Down);
+}
+
+long long benchCanMoveLeft(Snapshot *snapshot) {
+    return canMoveInDirection(snapshot->pieceBounds, &snapshot->playfield,
+                              Direction_Left);
+}
+
+long long benchCanMoveRight(Snapshot *snapshot) {
+    return canMoveInDirection(snapshot->pieceBounds, &snapshot->playfield,
+                              Direction_Right);
+}
+
+long long benchCanRotatePiece(Snapshot *snapshot) {
+    return canRotatePiece(snapshot->pieceBounds, &snapshot->playfield,
+                          snapshot->pieceIndex, &snapshot->rotationIndex);
+}
+
+long long benchRotatePiece(Snapshot *snapshot) {
+    rotatePiece(&snapshot->pieceBounds, &snapshot->playfield,
+                snapshot->pieceIndex, &snapshot->rotationIndex);
+    return snapshot->rotationIndex;
+}
+
+long long benchDropPieceOneRow(Snapshot *snapshot) {
+    dropPieceOneRow(&snapshot->pieceBounds, &snapshot->playfield);
+    return snapshot->pieceBounds.y;
+}
+
+long long benchConvertPieceToStatic(Snapshot *snapshot) {
+    convertPieceToStatic(snapshot->pieceBounds, &snapshot->playfield,
+                         snapshot->currentColor);
+    return snapshot->playfield.cells[snapshot->pieceBounds.y];
+}
+
+long long benchClearEmptyRows(Snapshot *snapshot) {
+    return clearEmptyRows(&snapshot->playfield);
+}
+
+long long benchSpawnRandomPiece(Snapshot *snapshot) {
+    return spawnRandomPiece(&snapshot->playfield, &snapshot->pieceBounds,
+                            &snapshot->currentColor, &snapshot->pieceIndex);
+}
+
+bool canRotate(const Snapshot *snapshot) {
+    int rotation = snapshot->rotationIndex;
+    return rotationFits(snapshot) &&
+           canRotatePiece(snapshot->pieceBounds, &snapshot->playfield,
+                          snapshot->pieceIndex, &rotation);
+}
+
+bool canDrop(const Snapshot *snapshot) {
+    return canMoveInDirection(snapshot->pieceBounds, &snapshot->playfield,
+                              Direction_Down);
+}
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Builds with TRACK_ALLOCATIONS and plays a fixed number of frames headless,
+# once as the game and once as the spectator wall. Fails if any frame after
+# warmup allocated. CC and LIBS can be overridden like the README's build line
+# may need to be, e.g. LIBS="$(pkg-config --libs sdl2 SDL2_ttf) -lm".
+set -e
+
+CC=${CC:-clang}
+LIBS=${LIBS:--lsdl2 -lsdl2_ttf -lm}
+BINARY=${BINARY:-./tetris-allocations}
+FRAMES=${FRAMES:-600}
+
+$CC -Wall -O3 -DTRACK_ALLOCATIONS main.c tetris.c telemetry.c allocations.c \
+    $LIBS -o "$BINARY"
+
+# No window, no GPU: the dummy video driver with the software renderer
+export SDL_VIDEODRIVER=dummy
+export SDL_RENDER_DRIVER=software
+
+# Exits non-zero if a frame allocated, but also has to get as far as the
+# report: setup failures (no SDL, no window) exit 0 without one
+run() {
+    status=0
+    "$BINARY" "$@" > "$BINARY.log" || status=$?
+    cat "$BINARY.log"
+    [ "$status" -eq 0 ] &&
+        grep -q "^Frames that allocated after warmup: 0$" "$BINARY.log"
+}
+
+echo "Game, $FRAMES frames:"
+run --frames "$FRAMES" --sim-rate 1000
+echo "Spectator wall, $FRAMES frames:"
+run --spectate 64 --frames "$FRAMES"
+rm -f "$BINARY.log"
+echo "No allocations after warmup"
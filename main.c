@@ -1,29 +1,33 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <time.h>
 
+#include "allocations.h"
+#include "telemetry.h"
+#include "tetris.h"
+
 const int WINDOW_WIDTH = 640;
 const int WINDOW_HEIGHT = 480;
 
-#define PLAYFIELD_WIDTH 10
-#define PLAYFIELD_HEIGHT 25
-/* ^-- Unfortunately necessary for arrays */
-/* Height is 25 to allow for J and L to spawn correctly */
+/* Limits for --sim-rate and --render-rate, in Hz */
+const int MAX_SIMULATION_RATE = 1000;
+const int MAX_RENDER_RATE = 1000;
+
+/* Key presses waiting for the frame that shows them, for input latency */
+#define MAX_PENDING_INPUTS 16
+
+/* Rows to keep between the active piece and the edge of a scrolling view */
+const int VIEW_MARGIN = 4;
 
 const int SQUARE_WIDTH = 18;
-const int CURRENT_PIECE_NUMBER = 9; /* Placeholder for current piece */
 
 const SDL_Color BACKGROUND = {86, 129, 163, 255};
 const SDL_Color WHITE = {255, 255, 255};
 const SDL_Color GREY = {211, 211, 211};
 
-/* Pieces */
-/* 0 = I, 1 = J, 2 = L, 3 = O, 4 = S, 5 = T, 6 = Z */
-
-enum Direction { Direction_Down, Direction_Left, Direction_Right };
-
 const SDL_Color pieceColors[8] = {
     {255, 255, 255}, /* 0 = no square so skip */
     {0, 255, 255},   /* Cyan */
@@ -35,262 +39,220 @@ const SDL_Color pieceColors[8] = {
     {255, 0, 0}      /* Red */
 };
 
+/* Text is drawn from glyphs rendered once up front, so nothing gets created
+ * or destroyed per frame */
 typedef struct {
-    int x;
-    int y;
-} Coord;
-
-/* clang-format off */
-const int pieceRotations[7][4][4][4] = {
-    /* I */
-    {
-        {
-            {0, 0, 1, 0,},
-            {0, 0, 1, 0,},
-            {0, 0, 1, 0,},
-            {0, 0, 1, 0,},
-        },
-        {
-            {0, 0, 0, 0,},
-            {1, 1, 1, 1,},
-            {0, 0, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {0, 0, 1, 0,},
-            {0, 0, 1, 0,},
-            {0, 0, 1, 0,},
-            {0, 0, 1, 0,},
-        },
-        {
-            {0, 0, 0, 0,},
-            {1, 1, 1, 1,},
-            {0, 0, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-    },
-    /* J */
-    {
-        {
-            {0, 0, 0, 0,},
-            {1, 1, 1, 0,},
-            {0, 0, 1, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {0, 1, 0, 0,},
-            {0, 1, 0, 0,},
-            {1, 1, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {1, 0, 0, 0,},
-            {1, 1, 1, 0,},
-            {0, 0, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {0, 1, 1, 0,},
-            {0, 1, 0, 0,},
-            {0, 1, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-    },
-    /* L */
-    {
-        {
-            {0, 0, 0, 0,},
-            {1, 1, 1, 0,},
-            {1, 0, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {1, 1, 0, 0,},
-            {0, 1, 0, 0,},
-            {0, 1, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {0, 0, 1, 0,},
-            {1, 1, 1, 0,},
-            {0, 0, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {0, 1, 0, 0,},
-            {0, 1, 0, 0,},
-            {0, 1, 1, 0,},
-            {0, 0, 0, 0,},
-        },
-    },
-    /* O */
-    {
-        {
-            {1, 1, 0, 0,},
-            {1, 1, 0, 0,},
-            {0, 0, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {1, 1, 0, 0,},
-            {1, 1, 0, 0,},
-            {0, 0, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {1, 1, 0, 0,},
-            {1, 1, 0, 0,},
-            {0, 0, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {1, 1, 0, 0,},
-            {1, 1, 0, 0,},
-            {0, 0, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-    },
-    /* S */
-    {
-        {
-            {0, 1, 1, 0,},
-            {1, 1, 0, 0,},
-            {0, 0, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {0, 1, 0, 0,},
-            {0, 1, 1, 0,},
-            {0, 0, 1, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {0, 0, 0, 0,},
-            {0, 1, 1, 0,},
-            {1, 1, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {1, 0, 0, 0,},
-            {1, 1, 0, 0,},
-            {0, 1, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-    },
-    /* T */
-    {
-        {
-            {0, 1, 0, 0,},
-            {1, 1, 1, 0,},
-            {0, 0, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {0, 1, 0, 0,},
-            {0, 1, 1, 0,},
-            {0, 1, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {0, 0, 0, 0,},
-            {1, 1, 1, 0,},
-            {0, 1, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {0, 1, 0, 0,},
-            {1, 1, 0, 0,},
-            {0, 1, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-    },
-    /* Z */
-    {
-        {
-            {1, 1, 0, 0,},
-            {0, 1, 1, 0,},
-            {0, 0, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {0, 0, 1, 0,},
-            {0, 1, 1, 0,},
-            {0, 1, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {0, 0, 0, 0,},
-            {1, 1, 0, 0,},
-            {0, 1, 1, 0,},
-            {0, 0, 0, 0,},
-        },
-        {
-            {0, 1, 0, 0,},
-            {1, 1, 0, 0,},
-            {1, 0, 0, 0,},
-            {0, 0, 0, 0,},
-        },
-    }
-};
-/* clang-format on */
+    SDL_Texture *textures[128];
+    SDL_Rect sizes[128];
+} GlyphCache;
 
-const int pieceOffsets[7][2] = {
-    {0, 0}, {-1, 0}, {-1, 0}, {0, 1}, {0, 0}, {0, 0}, {0, 0},
-};
+/* Everything needed to simulate one bot game on the spectator wall (the
+ * normal game keeps its state in a Simulation) */
+typedef struct {
+    Playfield playfield;
+    SDL_Rect pieceBounds;
+    int pieceIndex;
+    int rotationIndex;
+    int currentColor;
+    int framesSinceLastFall;
+    int rotationsLeft; /* What the bot still wants to do with this piece */
+    int shiftsLeft;
+    int score;
+} Board;
+
+/* Key presses and releases, handed from the main thread to the simulation
+ * thread */
+typedef struct {
+    Uint32 type; /* SDL_KEYDOWN or SDL_KEYUP */
+    SDL_Keycode key;
+} InputEvent;
+
+#define INPUT_QUEUE_SIZE 64 /* Has to be a power of two */
+
+/* Single producer (main thread), single consumer (simulation thread), so
+ * each end only ever moves its own index */
+typedef struct {
+    InputEvent events[INPUT_QUEUE_SIZE];
+    SDL_atomic_t head; /* Next to read */
+    SDL_atomic_t tail; /* Next to write */
+} InputQueue;
+
+/* A key press the main thread is waiting to see on screen, for telemetry */
+typedef struct {
+    Uint32 sequence; /* Shown once the simulation has applied this many */
+    Uint32 timestamp;
+} PendingInput;
+
+/* Everything the renderer needs from one tick, never changed once published */
+typedef struct {
+    Playfield playfield;
+    SDL_Rect pieceBounds;
+    SDL_Rect previousBounds; /* Where the piece was before the tick */
+    int currentColor;
+    int score;
+    int level;
+    double tickTime; /* When the tick was due, in getMilliseconds() time */
+    Uint64 ticks;
+    Uint64 piecesLocked;
+    Uint64 linesBySize[5];
+    Uint32 inputsApplied; /* Input events taken off the queue so far */
+    bool gameOver;
+} Snapshot;
+
+/* The simulation fills the back snapshot and swaps it into the middle, the
+ * renderer swaps the middle out for its front one whenever there's a newer
+ * one. Neither ever waits for the other, or sees a half written snapshot. */
+typedef struct {
+    Snapshot snapshots[3];
+    int back;            /* Only touched by the simulation thread */
+    int front;           /* Only touched by the render thread */
+    SDL_atomic_t middle; /* Index, plus SNAPSHOT_FRESH until it's read */
+} TripleBuffer;
+
+#define SNAPSHOT_FRESH 4
+
+/* The game itself, run at a fixed rate on its own thread so a slow frame
+ * can't hold up gravity or input */
+typedef struct {
+    /* Set up before the thread starts */
+    double tickLength; /* In milliseconds */
+    double gravityTable[MAX_LEVEL + 1]; /* Rows per tick for every level */
+    double softDropPerTick;
+    int lockDelayTicks;
+
+    /* Shared with the render thread */
+    InputQueue input;
+    TripleBuffer snapshots;
+    SDL_atomic_t quit;
+
+    /* Only touched by the simulation thread (until it's been waited on) */
+    Playfield playfield;
+    SDL_Rect pieceBounds;
+    SDL_Rect previousBounds;
+    PieceFall fall;
+    int pieceIndex;
+    int rotationIndex;
+    int currentColor;
+    int score;
+    int level;
+    int linesCleared;
+    bool softDropping;
+    bool gameOver;
+    Uint64 ticks;
+    Uint64 piecesLocked;
+    Uint64 linesBySize[5];
+    Uint32 inputsApplied;
+    double busyTime; /* Spent simulating rather than waiting, in ms */
+} Simulation;
+
+const int SPECTATOR_FRAMES_TO_FALL = 4;
+const int SPECTATOR_GAP = 6; /* Pixels between boards on the wall */
+const int SPECTATOR_DEFAULT_BOARDS = 256;
+const int SPECTATOR_MIN_SQUARE = 1; /* Zoom limits, in pixels per square */
+const int SPECTATOR_MAX_SQUARE = 18;
 
 /* Utility */
 bool initializeSDL();
-int max(int a, int b) { return a > b ? a : b; }
 
 /* Rendering stuff */
-void renderText(SDL_Renderer *renderer, TTF_Font *font, const char *text,
-                SDL_Rect *rect, SDL_Color color, int x, int y);
+bool createGlyphCache(GlyphCache *glyphs, SDL_Renderer *renderer,
+                      TTF_Font *font, SDL_Color color);
+void destroyGlyphCache(GlyphCache *glyphs);
+void renderText(SDL_Renderer *renderer, const GlyphCache *glyphs,
+                const char *text, SDL_Rect *rect, int x, int y);
 void renderPlayfieldBackground(SDL_Renderer *renderer,
                                SDL_Rect playfieldDimensions,
-                               SDL_Rect playfieldBorder);
+                               SDL_Rect playfieldBorder, int squareWidth);
 void renderPlayfieldGridlines(SDL_Renderer *renderer,
-                              SDL_Rect playfieldDimensions);
-void renderPlayfield(SDL_Renderer *renderer,
-                     int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH],
-                     SDL_Rect playfieldDimensions, int currentColor);
-
-/* Actual game functions */
-int getMaxRightBound(SDL_Rect pieceBounds);
-int getMaxBottomBound(SDL_Rect pieceBounds);
-bool spawnRandomPiece(int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH],
-                      SDL_Rect *pieceBounds, int *currentColor,
-                      int *pieceIndex);
-bool canMoveInDirection(SDL_Rect pieceBounds,
-                        int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH],
-                        enum Direction direction);
-bool canRotatePiece(SDL_Rect pieceBounds,
-                    int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH],
-                    int pieceIndex, int *currentRotation);
-void dropPieceOneRow(SDL_Rect *pieceBounds,
-                     int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH]);
-void movePieceLeft(SDL_Rect *pieceBounds,
-                   int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH]);
-void movePieceRight(SDL_Rect *pieceBounds,
-                    int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH]);
-void rotatePiece(SDL_Rect *pieceBounds,
-                 int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH],
-                 int pieceIndex, int *currentRotation);
-void convertPieceToStatic(SDL_Rect pieceBounds,
-                          int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH],
-                          int currentColor);
-int clearEmptyRows(int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH]);
-void shiftAllRowsDown(int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH],
-                      int end);
-int scoreForRowsCleared(int rowsCleared);
-
-int main() {
+                              SDL_Rect playfieldDimensions, int squareWidth);
+void renderPlayfield(SDL_Renderer *renderer, const Playfield *playfield,
+                     SDL_Rect playfieldDimensions, int squareWidth,
+                     int firstRow, int currentColor, SDL_Point pieceOffset);
+int scrollToFollowPiece(int viewTop, int visibleRows, SDL_Rect pieceBounds,
+                        const Playfield *playfield);
+
+/* Simulation thread */
+bool createSimulation(Simulation *simulation, int width, int height,
+                      int simulationRate);
+void destroySimulation(Simulation *simulation);
+int runSimulation(void *data);
+void applyInput(Simulation *simulation, InputEvent event);
+void stepSimulation(Simulation *simulation);
+void publishSnapshot(Simulation *simulation, double tickTime);
+const Snapshot *acquireSnapshot(TripleBuffer *buffer);
+bool pushInput(InputQueue *queue, InputEvent event);
+bool popInput(InputQueue *queue, InputEvent *event);
+double getMilliseconds();
+
+/* Spectator wall */
+int runSpectatorWall(SDL_Renderer *renderer, int boardCount, int frameLimit);
+void resetBoard(Board *board);
+void spawnBoardPiece(Board *board);
+int stepBoard(Board *board);
+void appendQuad(SDL_Vertex *vertices, int *vertexCount, float x, float y,
+                float w, float h, SDL_Color color);
+void appendBoardGeometry(SDL_Vertex *vertices, int *vertexCount, Board *board,
+                         float x, float y, float squareWidth);
+
+int main(int argc, char *argv[]) {
+    /* Has to be hooked up before anything (including SDL) allocates */
+    startTrackingAllocations();
     srand(time(0));
 
-    int score = 0;
-    int playfieldGrid[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH] = {0};
+    /* ./a.out --spectate [boards] watches a wall of bot games instead */
+    /* ./a.out --board WIDTHxHEIGHT plays on a different sized board */
+    /* ./a.out --sim-rate HZ --render-rate HZ decouples the two (a render
+     * rate of 0 means draw as fast as possible) */
+    /* ./a.out --frames N quits by itself after N frames, for scripts */
+    int spectatorBoards = 0;
+    int boardWidth = PLAYFIELD_WIDTH;
+    int boardHeight = PLAYFIELD_HEIGHT - 1;
+    int simulationRate = 60;
+    int renderRate = 0;
+    int frameLimit = 0; /* Run until closed */
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--spectate") == 0) {
+            int count = i + 1 < argc ? atoi(argv[i + 1]) : 0;
+            if (count > 0) {
+                ++i;
+            }
+            spectatorBoards = count > 0 ? count : SPECTATOR_DEFAULT_BOARDS;
+        } else if (strcmp(argv[i], "--board") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &boardWidth, &boardHeight) != 2 ||
+                boardWidth < MIN_BOARD_WIDTH || boardWidth > MAX_BOARD_WIDTH ||
+                boardHeight < MIN_BOARD_HEIGHT ||
+                boardHeight > MAX_BOARD_HEIGHT) {
+                printf("Board size must be between %dx%d and %dx%d!\n",
+                       MIN_BOARD_WIDTH, MIN_BOARD_HEIGHT, MAX_BOARD_WIDTH,
+                       MAX_BOARD_HEIGHT);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--sim-rate") == 0 && i + 1 < argc) {
+            simulationRate = atoi(argv[++i]);
+            if (simulationRate < 1 || simulationRate > MAX_SIMULATION_RATE) {
+                printf("Simulation rate must be between 1 and %d!\n",
+                       MAX_SIMULATION_RATE);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--render-rate") == 0 && i + 1 < argc) {
+            renderRate = atoi(argv[++i]);
+            if (renderRate < 0 || renderRate > MAX_RENDER_RATE) {
+                printf("Render rate must be between 0 and %d!\n",
+                       MAX_RENDER_RATE);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frameLimit = atoi(argv[++i]);
+            if (frameLimit < 0) {
+                printf("Frame count can't be negative!\n");
+                return 0;
+            }
+        }
+    }
 
     if (!initializeSDL()) {
         printf("Initialization failed!\n");
+        return 0;
     }
 
     SDL_Window *window = SDL_CreateWindow("Yeetris", SDL_WINDOWPOS_CENTERED,
@@ -315,11 +277,42 @@ int main() {
     SDL_RenderClear(renderer);
     SDL_RenderPresent(renderer);
 
+    if (spectatorBoards > 0) {
+        runSpectatorWall(renderer, spectatorBoards, frameLimit);
+
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        TTF_Quit();
+        SDL_Quit();
+#ifdef TRACK_ALLOCATIONS
+        return reportAllocations() > 0;
+#else
+        return 0;
+#endif
+    }
+
+    Simulation simulation;
+    if (!createSimulation(&simulation, boardWidth, boardHeight,
+                          simulationRate)) {
+        printf("Couldn't allocate playfield!\n");
+        return 0;
+    }
+
     TTF_Font *arial = TTF_OpenFont("arial.ttf", 25);
+    GlyphCache whiteText;
+    if (!arial || !createGlyphCache(&whiteText, renderer, arial, WHITE)) {
+        printf("Couldn't load the font!\n");
+        return 0;
+    }
 
     /* Setup playfield */
-    SDL_Rect playfieldRect = {WINDOW_WIDTH / 2 - 5 * SQUARE_WIDTH, 35,
-                              10 * SQUARE_WIDTH, 24 * SQUARE_WIDTH};
+    /* Wide boards get smaller squares, tall ones scroll to follow the piece */
+    int squareWidth = min(SQUARE_WIDTH, (WINDOW_WIDTH - 20) / boardWidth);
+    int visibleRows = min(boardHeight, (WINDOW_HEIGHT - 45) / squareWidth);
+    int viewTop = 0;
+    SDL_Rect playfieldRect = {
+        WINDOW_WIDTH / 2 - boardWidth * squareWidth / 2, 35,
+        boardWidth * squareWidth, visibleRows * squareWidth};
     SDL_Rect playfieldBorderRect = playfieldRect;
     playfieldBorderRect.w += 1;
     playfieldBorderRect.h += 1;
@@ -328,97 +321,66 @@ int main() {
     SDL_Event e;
     bool quit = false;
 
-    int counter = 0;
+    int framesRendered = 0;
     SDL_Rect textLocation;
     const int SCORE_LENGTH = 20;
     char scoreText[20];
+    char levelText[20];
+
+    /* Carries on without it if shared memory isn't available */
+    Telemetry telemetry;
+    openTelemetry(&telemetry, "game");
+    telemetry.data.boards = 1;
+    PendingInput pendingInputs[MAX_PENDING_INPUTS];
+    int pendingInputCount = 0;
+    Uint32 inputsSent = 0;
+
+    /* The game runs on its own thread from here on, this one just forwards
+     * input and draws whatever the latest tick was */
+    SDL_Thread *simulationThread =
+        SDL_CreateThread(runSimulation, "simulation", &simulation);
+    if (!simulationThread) {
+        printf("Couldn't start the simulation thread!\n");
+        quit = true;
+    }
 
-    /* Timestep stuff from https://gafferongames.com/post/fix_your_timestep/ */
-    double currentTime = SDL_GetTicks();
-    double accumulator = 0;
-    int FPS = 60;
-
-    int numberOfFramesToFall = 90;
-    int framesSinceLastFall = 0;
-    SDL_Rect pieceBounds;
-    int pieceIndex = 0;
-    int rotationIndex = 0;
-    int currentColor;
-    spawnRandomPiece(playfieldGrid, &pieceBounds, &currentColor, &pieceIndex);
+    double startTime = getMilliseconds();
+    double currentTime = startTime;
+    double nextFrameTime = startTime;
+    double renderBusyTime = 0; /* Everything but the frame rate cap */
+    const Snapshot *snapshot = acquireSnapshot(&simulation.snapshots);
 
     while (!quit) {
-        double newTime = SDL_GetTicks();
+        double newTime = getMilliseconds();
         double frameTime = newTime - currentTime;
         currentTime = newTime;
+        recordFrameTime(&telemetry, frameTime);
 
-        accumulator += frameTime;
+        setAllocationPhase(AllocationPhase_Input);
         while (SDL_PollEvent(&e) != 0) {
             if (e.type == SDL_QUIT) {
                 quit = true;
-            } else if (e.type == SDL_KEYDOWN) {
-                switch (e.key.keysym.sym) {
-                    case SDLK_DOWN:
-                        /* Speed up downward movement */
-                        numberOfFramesToFall = 2;
-                        break;
-                    case SDLK_LEFT:
-                        if (canMoveInDirection(pieceBounds, playfieldGrid,
-                                               Direction_Left)) {
-                            movePieceLeft(&pieceBounds, playfieldGrid);
-                        }
-                        break;
-                    case SDLK_RIGHT:
-                        if (canMoveInDirection(pieceBounds, playfieldGrid,
-                                               Direction_Right)) {
-                            movePieceRight(&pieceBounds, playfieldGrid);
-                        }
-                        break;
-                    case SDLK_UP:
-                        if (canRotatePiece(pieceBounds, playfieldGrid,
-                                           pieceIndex, &rotationIndex)) {
-                            rotatePiece(&pieceBounds, playfieldGrid, pieceIndex,
-                                        &rotationIndex);
-                        }
-                        break;
+            } else if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) {
+                InputEvent event = {e.type, e.key.keysym.sym};
+                if (!pushInput(&simulation.input, event)) {
+                    continue; /* Simulation is way behind, drop it */
                 }
-            } else if (e.type == SDL_KEYUP) {
-                if (e.key.keysym.sym == SDLK_DOWN) {
-                    /* Return to normal speed */
-                    numberOfFramesToFall = 30;
+                ++inputsSent;
+                if (e.type == SDL_KEYDOWN &&
+                    pendingInputCount < MAX_PENDING_INPUTS) {
+                    pendingInputs[pendingInputCount++] =
+                        (PendingInput){inputsSent, e.key.timestamp};
                 }
             }
         }
 
-        while (accumulator > (1000. / FPS)) {
-            ++framesSinceLastFall;
-            /* Constant interval to drop pieces by */
-            if (framesSinceLastFall > numberOfFramesToFall) {
-                if (canMoveInDirection(pieceBounds, playfieldGrid,
-                                       Direction_Down)) {
-                    dropPieceOneRow(&pieceBounds, playfieldGrid);
-                } else {
-                    convertPieceToStatic(pieceBounds, playfieldGrid,
-                                         currentColor);
-
-                    /* Scoring stuff */
-                    int rowsCleared = clearEmptyRows(playfieldGrid);
-                    score += scoreForRowsCleared(rowsCleared);
-
-                    /* Next piece */
-                    bool success = spawnRandomPiece(playfieldGrid, &pieceBounds,
-                                                    &currentColor, &pieceIndex);
-                    rotationIndex = 0;
-
-                    if (!success) {
-                        printf("Game over!\n");
-                        quit = true;
-                    }
-                }
-                framesSinceLastFall = 0;
-            }
-            /* Update state stuff */
-            ++counter;
-            accumulator -= 1000. / FPS;
+        /* The update itself is on the other thread, all that happens here
+         * is picking up the last snapshot it finished */
+        setAllocationPhase(AllocationPhase_Update);
+        snapshot = acquireSnapshot(&simulation.snapshots);
+        if (snapshot->gameOver) {
+            printf("Game over!\n");
+            quit = true;
         }
 
         if (quit) {
@@ -426,27 +388,103 @@ int main() {
         }
 
         /* Rendering stuff */
+        setAllocationPhase(AllocationPhase_Render);
         SDL_SetRenderDrawColor(renderer, BACKGROUND.r, BACKGROUND.g,
                                BACKGROUND.b, BACKGROUND.a);
         SDL_RenderClear(renderer);
 
         /* Draw title */
-        renderText(renderer, arial, "Yeetris", &textLocation, WHITE, 5, 0);
-        snprintf(scoreText, SCORE_LENGTH, "Score: %d", score);
-        renderText(renderer, arial, scoreText, &textLocation, WHITE, 5,
+        renderText(renderer, &whiteText, "Yeetris", &textLocation, 5, 0);
+        snprintf(scoreText, SCORE_LENGTH, "Score: %d", snapshot->score);
+        renderText(renderer, &whiteText, scoreText, &textLocation, 5,
+                   textLocation.y + textLocation.h);
+        snprintf(levelText, SCORE_LENGTH, "Level: %d", snapshot->level);
+        renderText(renderer, &whiteText, levelText, &textLocation, 5,
                    textLocation.y + textLocation.h);
 
         /* Draw playfield background/grid */
-        renderPlayfieldBackground(renderer, playfieldRect, playfieldBorderRect);
+        renderPlayfieldBackground(renderer, playfieldRect, playfieldBorderRect,
+                                  squareWidth);
 
         /* Render all the tiles in it the playfield */
-        renderPlayfield(renderer, playfieldGrid, playfieldRect, currentColor);
+        viewTop = scrollToFollowPiece(viewTop, visibleRows,
+                                      snapshot->pieceBounds,
+                                      &snapshot->playfield);
+
+        /* The piece is drawn part way between its last two ticks, by how
+         * long ago the last one was due (the last step of "fix your
+         * timestep") */
+        double alpha =
+            (getMilliseconds() - snapshot->tickTime) / simulation.tickLength;
+        alpha = alpha < 0 ? 0 : alpha > 1 ? 1 : alpha;
+        SDL_Point pieceOffset = {
+            lround((snapshot->previousBounds.x - snapshot->pieceBounds.x) *
+                   (1 - alpha) * squareWidth),
+            lround((snapshot->previousBounds.y - snapshot->pieceBounds.y) *
+                   (1 - alpha) * squareWidth)};
+        renderPlayfield(renderer, &snapshot->playfield, playfieldRect,
+                        squareWidth, viewTop, snapshot->currentColor,
+                        pieceOffset);
 
         SDL_RenderPresent(renderer);
+        ++framesRendered;
+        endAllocationFrame();
+        if (framesRendered == frameLimit) {
+            quit = true;
+        }
+
+        /* Input latency is from the key event to the present of the first
+         * snapshot the simulation made after taking it */
+        Uint32 presentedAt = SDL_GetTicks();
+        int stillPending = 0;
+        for (int i = 0; i < pendingInputCount; ++i) {
+            if ((Sint32)(snapshot->inputsApplied - pendingInputs[i].sequence) >=
+                0) {
+                recordInputLatency(&telemetry,
+                                   presentedAt - pendingInputs[i].timestamp);
+            } else {
+                pendingInputs[stillPending++] = pendingInputs[i];
+            }
+        }
+        pendingInputCount = stillPending;
+
+        telemetry.data.ticks = snapshot->ticks;
+        telemetry.data.frames = framesRendered;
+        telemetry.data.piecesLocked = snapshot->piecesLocked;
+        memcpy(telemetry.data.linesCleared, snapshot->linesBySize,
+               sizeof(telemetry.data.linesCleared));
+        telemetry.data.level = snapshot->level;
+        publishTelemetry(&telemetry, presentedAt);
+        renderBusyTime += getMilliseconds() - newTime;
+
+        if (renderRate > 0) {
+            /* Sleep off whatever is left of this frame's slot, slots are
+             * counted from the start so rounding doesn't add up */
+            nextFrameTime += 1000. / renderRate;
+            double now = getMilliseconds();
+            if (now < nextFrameTime) {
+                SDL_Delay((Uint32)(nextFrameTime - now));
+            } else {
+                nextFrameTime = now; /* Fell behind, don't try to catch up */
+            }
+        }
     }
 
-    printf("time reached: %f\n", currentTime);
-    printf("Overall FPS: %f\n", (counter / (currentTime / 1000.)));
+    SDL_AtomicSet(&simulation.quit, 1);
+    SDL_WaitThread(simulationThread, NULL);
+
+    double elapsed = currentTime - startTime;
+    printf("time reached: %f\n", elapsed);
+    printf("Overall FPS: %f\n", (framesRendered / (elapsed / 1000.)));
+    printf("Simulation rate: %f\n", (simulation.ticks / (elapsed / 1000.)));
+    printf("Simulation thread utilization: %.1f%%\n",
+           elapsed > 0 ? 100 * simulation.busyTime / elapsed : 0);
+    printf("Render thread utilization: %.1f%%\n",
+           elapsed > 0 ? 100 * renderBusyTime / elapsed : 0);
+
+    closeTelemetry(&telemetry);
+    destroySimulation(&simulation);
+    destroyGlyphCache(&whiteText);
 
     TTF_CloseFont(arial);
     arial = NULL;
@@ -459,6 +497,11 @@ int main() {
 
     TTF_Quit();
     SDL_Quit();
+
+#ifdef TRACK_ALLOCATIONS
+    /* Fails if any frame after warmup allocated, so scripts can check it */
+    return reportAllocations() > 0;
+#endif
 }
 
 bool initializeSDL() {
@@ -475,80 +518,134 @@ bool initializeSDL() {
     return true;
 }
 
-/* Inefficient solution slightly modified from */
-/* https://stackoverflow.com/questions/22852226/c-sdl2-how-to-regularly-update-a-renderered-text-ttf
- */
-void renderText(SDL_Renderer *renderer, TTF_Font *font, const char *text,
-                SDL_Rect *rect, SDL_Color color, int x, int y) {
-    SDL_Surface *surface = TTF_RenderText_Solid(font, text, color);
-    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
+bool createGlyphCache(GlyphCache *glyphs, SDL_Renderer *renderer,
+                      TTF_Font *font, SDL_Color color) {
+    memset(glyphs, 0, sizeof(*glyphs));
+
+    /* Printable ASCII is all we ever draw. Each one is rendered as a one
+     * character string, which on every SDL_ttf version comes out as wide as
+     * its advance and as tall as the font, so glyphs line up on the
+     * baseline and ' ' still takes up space. TTF_RenderGlyph_Solid only
+     * does that on newer versions. */
+    for (int c = ' '; c <= '~'; ++c) {
+        char text[2] = {(char)c, '\0'};
+        SDL_Surface *surface = TTF_RenderText_Solid(font, text, color);
+        if (!surface) {
+            continue;
+        }
+
+        glyphs->textures[c] = SDL_CreateTextureFromSurface(renderer, surface);
+        glyphs->sizes[c].w = surface->w;
+        glyphs->sizes[c].h = surface->h;
+        SDL_FreeSurface(surface);
+
+        if (!glyphs->textures[c]) {
+            destroyGlyphCache(glyphs);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void destroyGlyphCache(GlyphCache *glyphs) {
+    for (int c = 0; c < 128; ++c) {
+        if (glyphs->textures[c]) {
+            SDL_DestroyTexture(glyphs->textures[c]);
+            glyphs->textures[c] = NULL;
+        }
+    }
+}
 
+void renderText(SDL_Renderer *renderer, const GlyphCache *glyphs,
+                const char *text, SDL_Rect *rect, int x, int y) {
     rect->x = x;
     rect->y = y;
-    rect->w = surface->w;
-    rect->h = surface->h;
+    rect->w = rect->h = 0;
 
-    SDL_FreeSurface(surface);
-    SDL_RenderCopy(renderer, texture, NULL, rect);
-    SDL_DestroyTexture(texture);
+    for (const char *c = text; *c; ++c) {
+        unsigned char glyph = *c;
+        if (glyph >= 128 || !glyphs->textures[glyph]) {
+            continue;
+        }
+
+        SDL_Rect destination = glyphs->sizes[glyph];
+        destination.x = x + rect->w;
+        destination.y = y;
+        SDL_RenderCopy(renderer, glyphs->textures[glyph], NULL, &destination);
+
+        rect->w += destination.w;
+        rect->h = max(rect->h, destination.h);
+    }
 }
 
 void renderPlayfieldBackground(SDL_Renderer *renderer,
                                SDL_Rect playfieldDimensions,
-                               SDL_Rect playfieldBorder) {
+                               SDL_Rect playfieldBorder, int squareWidth) {
     SDL_SetRenderDrawColor(renderer, WHITE.r, WHITE.g, WHITE.b, WHITE.a);
     SDL_RenderFillRect(renderer, &playfieldDimensions);
 
     SDL_SetRenderDrawColor(renderer, GREY.r, GREY.g, GREY.b, GREY.a);
 
     /* Draw grid */
-    renderPlayfieldGridlines(renderer, playfieldDimensions);
+    renderPlayfieldGridlines(renderer, playfieldDimensions, squareWidth);
 
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderDrawRect(renderer, &playfieldBorder);
 }
 
 void renderPlayfieldGridlines(SDL_Renderer *renderer,
-                              SDL_Rect playfieldDimensions) {
+                              SDL_Rect playfieldDimensions, int squareWidth) {
     /* Draw vertical lines */
     for (int i = playfieldDimensions.x;
-         i < playfieldDimensions.x + playfieldDimensions.w; i += SQUARE_WIDTH) {
+         i < playfieldDimensions.x + playfieldDimensions.w; i += squareWidth) {
         SDL_RenderDrawLine(renderer, i, playfieldDimensions.y, i,
                            playfieldDimensions.y + playfieldDimensions.h);
     }
 
     /* Draw horizontal lines */
     for (int i = playfieldDimensions.y;
-         i < playfieldDimensions.y + playfieldDimensions.h; i += SQUARE_WIDTH) {
+         i < playfieldDimensions.y + playfieldDimensions.h; i += squareWidth) {
         SDL_RenderDrawLine(renderer, playfieldDimensions.x, i,
                            playfieldDimensions.x + playfieldDimensions.w, i);
     }
 }
 
-void renderPlayfield(SDL_Renderer *renderer,
-                     int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH],
-                     SDL_Rect playfieldDimensions, int currentColor) {
-    for (int i = 0; i < PLAYFIELD_HEIGHT - 1;
-         ++i) { /* Ignore first row when rendering */
-        for (int j = 0; j < PLAYFIELD_WIDTH; ++j) {
-            /* Reset color to white */
-            SDL_SetRenderDrawColor(renderer, WHITE.r, WHITE.g, WHITE.b,
-                                   WHITE.a);
-
-            /* Figure out where this square will actually be */
-            int currentSquare = playfield[i + 1][j];
+KERNEL void renderPlayfieldKernel(const int width, SDL_Renderer *renderer,
+                                  const Playfield *playfield,
+                                  SDL_Rect playfieldDimensions,
+                                  int squareWidth, int firstRow,
+                                  int currentColor, SDL_Point pieceOffset) {
+    int(*grid)[width] = (int(*)[width])playfield->cells;
+
+    /* Only the rows inside the viewport, +1 skips the hidden row */
+    int lastRow = min(firstRow + playfieldDimensions.h / squareWidth,
+                      playfield->height - 1);
+
+    for (int i = firstRow; i < lastRow; ++i) {
+        for (int j = 0; j < width; ++j) {
+            int currentSquare = grid[i + 1][j];
+            if (currentSquare == 0) { /* Background is already white */
+                continue;
+            }
 
             SDL_Color correspondingColor = currentSquare != CURRENT_PIECE_NUMBER
                                                ? pieceColors[currentSquare]
                                                : pieceColors[currentColor];
             SDL_Rect convertedLocation;
-            convertedLocation.x = playfieldDimensions.x + j * SQUARE_WIDTH + 1;
-            convertedLocation.y = playfieldDimensions.y + i * SQUARE_WIDTH + 1;
-            convertedLocation.w = convertedLocation.h = SQUARE_WIDTH - 1;
+            convertedLocation.x = playfieldDimensions.x + j * squareWidth + 1;
+            convertedLocation.y =
+                playfieldDimensions.y + (i - firstRow) * squareWidth + 1;
+            convertedLocation.w = convertedLocation.h = squareWidth - 1;
             /* All the +1 and -1's are to make the square fit nicely within the
              * grid
              */
 
+            if (currentSquare == CURRENT_PIECE_NUMBER) {
+                convertedLocation.x += pieceOffset.x;
+                convertedLocation.y += pieceOffset.y;
+            }
+
             /* Actually draw it */
             SDL_SetRenderDrawColor(renderer, correspondingColor.r,
                                    correspondingColor.g, correspondingColor.b,
@@ -558,295 +655,547 @@ void renderPlayfield(SDL_Renderer *renderer,
     }
 }
 
-int getMaxRightBound(SDL_Rect pieceBounds) {
-    return max(pieceBounds.x + pieceBounds.w, PLAYFIELD_WIDTH);
+void renderPlayfield(SDL_Renderer *renderer, const Playfield *playfield,
+                     SDL_Rect playfieldDimensions, int squareWidth,
+                     int firstRow, int currentColor, SDL_Point pieceOffset) {
+    /* An offset piece can poke out of the playfield, so clip it */
+    SDL_RenderSetClipRect(renderer, &playfieldDimensions);
+    SPECIALIZE_ON_WIDTH(
+        playfield->width,
+        renderPlayfieldKernel(KERNEL_WIDTH, renderer, playfield,
+                              playfieldDimensions, squareWidth, firstRow,
+                              currentColor, pieceOffset));
+    SDL_RenderSetClipRect(renderer, NULL);
 }
 
-int getMaxBottomBound(SDL_Rect pieceBounds) {
-    return max(pieceBounds.y + pieceBounds.h, PLAYFIELD_HEIGHT);
-}
+int scrollToFollowPiece(int viewTop, int visibleRows, SDL_Rect pieceBounds,
+                        const Playfield *playfield) {
+    int pieceTop = pieceBounds.y - 1; /* View rows don't count the hidden row */
+    int pieceBottom = pieceTop + pieceBounds.h;
 
-bool spawnRandomPiece(int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH],
-                      SDL_Rect *pieceBounds, int *currentColor,
-                      int *pieceIndex) {
-    *pieceIndex = rand() % 7;
+    if (pieceTop < viewTop + VIEW_MARGIN) {
+        viewTop = pieceTop - VIEW_MARGIN;
+    }
+    if (pieceBottom > viewTop + visibleRows - VIEW_MARGIN) {
+        viewTop = pieceBottom + VIEW_MARGIN - visibleRows;
+    }
 
-    int rotations[4][4][4];
-    memcpy(&rotations, &pieceRotations[*pieceIndex],
-           sizeof(pieceRotations[*pieceIndex]));
+    int maxViewTop = playfield->height - 1 - visibleRows;
+    return viewTop < 0 ? 0 : viewTop > maxViewTop ? maxViewTop : viewTop;
+}
 
-    int rowOffset = pieceOffsets[*pieceIndex][0];
-    int columnOffset = pieceOffsets[*pieceIndex][1];
+bool createSimulation(Simulation *simulation, int width, int height,
+                      int simulationRate) {
+    memset(simulation, 0, sizeof(*simulation));
+    if (!createPlayfield(&simulation->playfield, width, height)) {
+        return false;
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (!createPlayfield(&simulation->snapshots.snapshots[i].playfield,
+                             width, height)) {
+            destroySimulation(simulation);
+            return false;
+        }
+    }
+    simulation->snapshots.front = 0;
+    SDL_AtomicSet(&simulation->snapshots.middle, 1);
+    simulation->snapshots.back = 2;
+
+    simulation->tickLength = 1000. / simulationRate;
+    buildGravityTable(simulation->gravityTable, simulationRate);
+    simulation->softDropPerTick = SOFT_DROP_GRAVITY * 60 / simulationRate;
+    simulation->lockDelayTicks =
+        max(1, lround(LOCK_DELAY_FRAMES * simulationRate / 60.));
+
+    simulation->level = 1;
+    spawnRandomPiece(&simulation->playfield, &simulation->pieceBounds,
+                     &simulation->currentColor, &simulation->pieceIndex);
+    simulation->fall =
+        (PieceFall){LockState_Falling, 0, 0, 0, simulation->pieceBounds.y};
+    simulation->previousBounds = simulation->pieceBounds;
+
+    /* So the renderer has something to draw before the first tick */
+    publishSnapshot(simulation, getMilliseconds());
+    return true;
+}
 
-    for (int i = 0; i < 4; ++i) {
-        for (int j = 0; j < 4; ++j) {
-            int currentSquare = rotations[0][i][j];
+void destroySimulation(Simulation *simulation) {
+    destroyPlayfield(&simulation->playfield);
+    for (int i = 0; i < 3; ++i) {
+        destroyPlayfield(&simulation->snapshots.snapshots[i].playfield);
+    }
+}
 
-            if (playfield[i + rowOffset + 1][j + columnOffset + 3] != 0 &&
-                currentSquare != 0) {
-                return false;
-            }
+int runSimulation(void *data) {
+    Simulation *simulation = data;
+
+    /* Timestep stuff from https://gafferongames.com/post/fix_your_timestep/
+     * Ticks are due at fixed times from the start, so a late one is caught
+     * up on rather than pushing all the later ones back */
+    double nextTick = getMilliseconds() + simulation->tickLength;
+    setAllocationPhase(AllocationPhase_Simulation);
+
+    while (!SDL_AtomicGet(&simulation->quit) && !simulation->gameOver) {
+        double now = getMilliseconds();
+        if (now < nextTick) {
+            /* SDL_Delay only does whole milliseconds. Rounding down would
+             * come straight back with under 1ms left and spin at high sim
+             * rates, so round up instead: the tick is at most 1ms late, gets
+             * caught up, and snapshots carry when it was due so the render
+             * side doesn't notice. The wait isn't counted as busy. */
+            SDL_Delay((Uint32)ceil(nextTick - now));
+            continue;
+        }
 
-            if (currentSquare == 0) {
-                continue;
-            }
-            playfield[i + rowOffset + 1][j + columnOffset + 3] =
-                CURRENT_PIECE_NUMBER;
+        simulation->previousBounds = simulation->pieceBounds;
+        InputEvent event;
+        while (popInput(&simulation->input, &event)) {
+            applyInput(simulation, event);
+            ++simulation->inputsApplied;
         }
-    }
 
-    *currentColor = *pieceIndex + 1;
+        stepSimulation(simulation);
+        publishSnapshot(simulation, nextTick);
+        nextTick += simulation->tickLength;
+        simulation->busyTime += getMilliseconds() - now;
+    }
 
-    pieceBounds->x = columnOffset + 3;
-    pieceBounds->y = rowOffset + 1;
-    pieceBounds->w = pieceBounds->h = 4;
-    return true;
+    return 0;
 }
 
-bool canMoveInDirection(SDL_Rect pieceBounds,
-                        int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH],
-                        enum Direction direction) {
-    if (direction == Direction_Down) {
-        for (int i = pieceBounds.y; i < getMaxBottomBound(pieceBounds); ++i) {
-            for (int j = pieceBounds.x; j < getMaxRightBound(pieceBounds);
-                 ++j) {
-                int currentSquare = playfield[i][j];
-                if (currentSquare != CURRENT_PIECE_NUMBER) {
-                    continue;
-                }
-
-                if (i + 1 == PLAYFIELD_HEIGHT) { /* Reached bottom */
-                    return false;
-                }
+void applyInput(Simulation *simulation, InputEvent event) {
+    Playfield *playfield = &simulation->playfield;
+    SDL_Rect *pieceBounds = &simulation->pieceBounds;
 
-                if (playfield[i + 1][j] != CURRENT_PIECE_NUMBER &&
-                    playfield[i + 1][j] != 0) { /* Collided with something */
-                    return false;
-                }
-            }
+    if (event.type == SDL_KEYUP) {
+        if (event.key == SDLK_DOWN) {
+            /* Return to normal speed */
+            simulation->softDropping = false;
         }
-        return true;
-    } else if (direction == Direction_Left) {
-        for (int i = pieceBounds.y; i < getMaxBottomBound(pieceBounds); ++i) {
-            for (int j = pieceBounds.x; j < getMaxRightBound(pieceBounds);
-                 ++j) {
-                int currentSquare = playfield[i][j];
-                if (currentSquare != CURRENT_PIECE_NUMBER) {
-                    continue;
-                }
-
-                if (j - 1 < 0) { /* Reached left wall */
-                    return false;
-                }
+        return;
+    }
 
-                if (playfield[i][j - 1] != CURRENT_PIECE_NUMBER &&
-                    playfield[i][j - 1] != 0) { /* Collided with something */
-                    return false;
-                }
+    switch (event.key) {
+        case SDLK_DOWN:
+            /* Speed up downward movement */
+            simulation->softDropping = true;
+            break;
+        case SDLK_LEFT:
+            if (canMoveInDirection(*pieceBounds, playfield, Direction_Left)) {
+                movePieceLeft(pieceBounds, playfield);
+                resetLockDelay(&simulation->fall);
             }
-        }
+            break;
+        case SDLK_RIGHT:
+            if (canMoveInDirection(*pieceBounds, playfield, Direction_Right)) {
+                movePieceRight(pieceBounds, playfield);
+                resetLockDelay(&simulation->fall);
+            }
+            break;
+        case SDLK_UP:
+            if (canRotatePiece(*pieceBounds, playfield, simulation->pieceIndex,
+                               &simulation->rotationIndex)) {
+                rotatePiece(pieceBounds, playfield, simulation->pieceIndex,
+                            &simulation->rotationIndex);
+                resetLockDelay(&simulation->fall);
+            }
+            break;
+    }
+}
 
-        return true;
-    } else if (direction == Direction_Right) {
-        for (int i = pieceBounds.y; i < getMaxBottomBound(pieceBounds); ++i) {
-            for (int j = pieceBounds.x; j < getMaxRightBound(pieceBounds);
-                 ++j) {
-                int currentSquare = playfield[i][j];
-                if (currentSquare != CURRENT_PIECE_NUMBER) {
-                    continue;
-                }
+void stepSimulation(Simulation *simulation) {
+    Playfield *playfield = &simulation->playfield;
 
-                if (j + 1 == PLAYFIELD_WIDTH) { /* Reached right wall */
-                    return false;
-                }
+    double gravity = simulation->gravityTable[simulation->level];
+    if (simulation->softDropping && gravity < simulation->softDropPerTick) {
+        gravity = simulation->softDropPerTick;
+    }
 
-                if (playfield[i][j + 1] != CURRENT_PIECE_NUMBER &&
-                    playfield[i][j + 1] != 0) { /* Collided with something */
-                    return false;
-                }
-            }
+    if (stepPieceFall(&simulation->fall, &simulation->pieceBounds, playfield,
+                      gravity, simulation->lockDelayTicks)) {
+        convertPieceToStatic(simulation->pieceBounds, playfield,
+                             simulation->currentColor);
+
+        /* Scoring stuff */
+        int rowsCleared = clearEmptyRows(playfield);
+        simulation->score +=
+            scoreForRowsCleared(rowsCleared) * simulation->level;
+        simulation->linesCleared += rowsCleared;
+        simulation->level = levelForLinesCleared(simulation->linesCleared);
+        ++simulation->piecesLocked;
+        ++simulation->linesBySize[rowsCleared];
+
+        /* Next piece */
+        bool success = spawnRandomPiece(playfield, &simulation->pieceBounds,
+                                        &simulation->currentColor,
+                                        &simulation->pieceIndex);
+        simulation->rotationIndex = 0;
+        simulation->fall = (PieceFall){LockState_Falling, 0, 0, 0,
+                                       simulation->pieceBounds.y};
+        /* Don't slide from the last piece */
+        simulation->previousBounds = simulation->pieceBounds;
+
+        if (!success) {
+            simulation->gameOver = true;
         }
+    }
+
+    ++simulation->ticks;
+}
+
+void publishSnapshot(Simulation *simulation, double tickTime) {
+    TripleBuffer *buffer = &simulation->snapshots;
+    Snapshot *snapshot = &buffer->snapshots[buffer->back];
+    const Playfield *playfield = &simulation->playfield;
+
+    memcpy(snapshot->playfield.cells, playfield->cells,
+           (size_t)playfield->width * playfield->height * sizeof(int));
+    snapshot->pieceBounds = simulation->pieceBounds;
+    snapshot->previousBounds = simulation->previousBounds;
+    snapshot->currentColor = simulation->currentColor;
+    snapshot->score = simulation->score;
+    snapshot->level = simulation->level;
+    snapshot->tickTime = tickTime;
+    snapshot->ticks = simulation->ticks;
+    snapshot->piecesLocked = simulation->piecesLocked;
+    memcpy(snapshot->linesBySize, simulation->linesBySize,
+           sizeof(snapshot->linesBySize));
+    snapshot->inputsApplied = simulation->inputsApplied;
+    snapshot->gameOver = simulation->gameOver;
+
+    /* Everything above has to land before the renderer can pick it up */
+    SDL_MemoryBarrierRelease();
+    buffer->back = SDL_AtomicSet(&buffer->middle,
+                                 buffer->back | SNAPSHOT_FRESH) &
+                   ~SNAPSHOT_FRESH;
+}
 
-        return true;
+const Snapshot *acquireSnapshot(TripleBuffer *buffer) {
+    /* Nothing new means keep drawing the one we've got */
+    if (SDL_AtomicGet(&buffer->middle) & SNAPSHOT_FRESH) {
+        buffer->front =
+            SDL_AtomicSet(&buffer->middle, buffer->front) & ~SNAPSHOT_FRESH;
+        SDL_MemoryBarrierAcquire();
     }
-    return false;
+    return &buffer->snapshots[buffer->front];
 }
 
-bool canRotatePiece(SDL_Rect pieceBounds,
-                    int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH],
-                    int pieceIndex, int *currentRotation) {
-    int rotations[4][4][4];
-    memcpy(&rotations, &pieceRotations[pieceIndex],
-           sizeof(pieceRotations[pieceIndex]));
-
-    for (int i = 0; i < 4; ++i) {
-        for (int j = 0; j < 4; ++j) {
-            int rotationSquare = rotations[(*currentRotation + 1) % 4][i][j];
-            if (rotationSquare == 0) {
-                continue;
-            }
-            int playfieldRow = i + pieceBounds.y;
-            int playfieldColumn = j + pieceBounds.x;
-            if (playfieldRow >= PLAYFIELD_HEIGHT ||
-                playfieldColumn >= PLAYFIELD_WIDTH || playfieldColumn < 0) {
-                return false;
-            }
-        }
+bool pushInput(InputQueue *queue, InputEvent event) {
+    int tail = SDL_AtomicGet(&queue->tail);
+    if (tail - SDL_AtomicGet(&queue->head) == INPUT_QUEUE_SIZE) {
+        return false; /* Full */
     }
 
+    queue->events[tail & (INPUT_QUEUE_SIZE - 1)] = event;
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&queue->tail, tail + 1);
     return true;
 }
-void dropPieceOneRow(SDL_Rect *pieceBounds,
-                     int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH]) {
-    for (int i = getMaxBottomBound(*pieceBounds); i >= pieceBounds->y; --i) {
-        for (int j = pieceBounds->x; j < getMaxRightBound(*pieceBounds); ++j) {
-            if (j >= PLAYFIELD_WIDTH || i >= PLAYFIELD_HEIGHT) {
-                continue;
-            }
-            if (playfield[i][j] != CURRENT_PIECE_NUMBER) {
-                continue;
-            }
-            playfield[i + 1][j] = playfield[i][j];
-            playfield[i][j] = 0;
-        }
+
+bool popInput(InputQueue *queue, InputEvent *event) {
+    int head = SDL_AtomicGet(&queue->head);
+    if (head == SDL_AtomicGet(&queue->tail)) {
+        return false; /* Empty */
     }
-    pieceBounds->y++;
+
+    SDL_MemoryBarrierAcquire();
+    *event = queue->events[head & (INPUT_QUEUE_SIZE - 1)];
+    /* The slot can't be reused until we're done reading it */
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&queue->head, head + 1);
+    return true;
 }
 
-void movePieceLeft(SDL_Rect *pieceBounds,
-                   int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH]) {
-    for (int i = pieceBounds->y; i < getMaxBottomBound(*pieceBounds); ++i) {
-        for (int j = pieceBounds->x; j < getMaxRightBound(*pieceBounds); ++j) {
-            if (j >= PLAYFIELD_WIDTH || i >= PLAYFIELD_HEIGHT) {
-                continue;
-            }
-            if (playfield[i][j] != CURRENT_PIECE_NUMBER) {
-                continue;
-            }
-            playfield[i][j - 1] = playfield[i][j];
-            playfield[i][j] = 0;
-        }
-    }
-    pieceBounds->x--;
+double getMilliseconds() {
+    return SDL_GetPerformanceCounter() * 1000. / SDL_GetPerformanceFrequency();
 }
 
-void movePieceRight(SDL_Rect *pieceBounds,
-                    int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH]) {
-    for (int i = pieceBounds->y; i < getMaxBottomBound(*pieceBounds); ++i) {
-        for (int j = getMaxRightBound(*pieceBounds); j >= pieceBounds->x; --j) {
-            if (j >= PLAYFIELD_WIDTH || i >= PLAYFIELD_HEIGHT) {
-                continue;
-            }
-            if (playfield[i][j] != CURRENT_PIECE_NUMBER) {
-                continue;
-            }
-            playfield[i][j + 1] = playfield[i][j];
-            playfield[i][j] = 0;
-        }
+int runSpectatorWall(SDL_Renderer *renderer, int boardCount, int frameLimit) {
+    Board *boards = malloc(boardCount * sizeof(Board));
+
+    /* Only boards in grid rows that overlap the window get drawn, and the
+     * most of those fit when zoomed all the way out. Worst case every one of
+     * them has every square filled. */
+    int minCellWidth = PLAYFIELD_WIDTH * SPECTATOR_MIN_SQUARE + SPECTATOR_GAP;
+    int minCellHeight =
+        (PLAYFIELD_HEIGHT - 1) * SPECTATOR_MIN_SQUARE + SPECTATOR_GAP;
+    int maxVisibleBoards =
+        max(1, (WINDOW_WIDTH - SPECTATOR_GAP) / minCellWidth) *
+        (WINDOW_HEIGHT / minCellHeight + 2); /* Part rows top and bottom */
+    int maxVerticesPerBoard =
+        (2 + (PLAYFIELD_HEIGHT - 1) * PLAYFIELD_WIDTH) * 6;
+    SDL_Vertex *vertices =
+        malloc((size_t)min(boardCount, maxVisibleBoards) *
+               maxVerticesPerBoard * sizeof(SDL_Vertex));
+
+    if (!boards || !vertices) {
+        printf("Couldn't allocate %d boards!\n", boardCount);
+        free(boards);
+        free(vertices);
+        return 0;
     }
-    pieceBounds->x++;
-}
 
-void rotatePiece(SDL_Rect *pieceBounds,
-                 int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH],
-                 int pieceIndex, int *currentRotation) {
-    int rotations[4][4][4];
-    memcpy(&rotations, &pieceRotations[pieceIndex],
-           sizeof(pieceRotations[pieceIndex]));
-
-    *currentRotation = (*currentRotation + 1) % 4;
-    for (int i = 0; i < 4; ++i) {
-        for (int j = 0; j < 4; ++j) {
-            int rotationSquare = rotations[*currentRotation][i][j];
-            if (rotationSquare == 0) {
-                continue;
-            }
-            int playfieldRow = i + pieceBounds->y;
-            int playfieldColumn = j + pieceBounds->x;
-            playfield[playfieldRow][playfieldColumn] =
-                10; /* Temporary value to erase all the old squares */
+    /* Spectator boards are always the default size */
+    for (int i = 0; i < boardCount; ++i) {
+        if (!createPlayfield(&boards[i].playfield, PLAYFIELD_WIDTH,
+                             PLAYFIELD_HEIGHT - 1)) {
+            printf("Couldn't allocate %d boards!\n", boardCount);
+            boardCount = i;
+            break;
         }
+        resetBoard(&boards[i]);
     }
 
-    for (int i = pieceBounds->y; i < getMaxBottomBound(*pieceBounds); ++i) {
-        for (int j = pieceBounds->x; j < getMaxRightBound(*pieceBounds); ++j) {
-            if (playfield[i][j] == CURRENT_PIECE_NUMBER) {
-                playfield[i][j] = 0;
+    SDL_Event e;
+    bool quit = false;
+    int squareWidth = 4;
+    int scrollY = 0;
+
+    double currentTime = SDL_GetTicks();
+    double accumulator = 0;
+    int FPS = 60;
+
+    /* Render cost bookkeeping */
+    Uint64 renderTicks = 0;
+    long long boardsDrawn = 0;
+    int framesRendered = 0;
+    double startTime = currentTime;
+
+    Telemetry telemetry;
+    openTelemetry(&telemetry, "spectator");
+    telemetry.data.level = 1;
+    telemetry.data.boards = boardCount;
+
+    while (!quit) {
+        double newTime = SDL_GetTicks();
+        recordFrameTime(&telemetry, newTime - currentTime);
+        accumulator += newTime - currentTime;
+        currentTime = newTime;
+
+        setAllocationPhase(AllocationPhase_Input);
+        while (SDL_PollEvent(&e) != 0) {
+            if (e.type == SDL_QUIT) {
+                quit = true;
+            } else if (e.type == SDL_MOUSEWHEEL) {
+                scrollY -= e.wheel.y * 40;
+            } else if (e.type == SDL_KEYDOWN) {
+                switch (e.key.keysym.sym) {
+                    case SDLK_UP:
+                        scrollY -= 40;
+                        break;
+                    case SDLK_DOWN:
+                        scrollY += 40;
+                        break;
+                    case SDLK_EQUALS:
+                        squareWidth =
+                            min(squareWidth + 1, SPECTATOR_MAX_SQUARE);
+                        break;
+                    case SDLK_MINUS:
+                        squareWidth =
+                            max(squareWidth - 1, SPECTATOR_MIN_SQUARE);
+                        break;
+                }
             }
-            if (playfield[i][j] == 10) {
-                playfield[i][j] = CURRENT_PIECE_NUMBER;
+        }
+
+        setAllocationPhase(AllocationPhase_Update);
+        while (accumulator > (1000. / FPS)) {
+            for (int i = 0; i < boardCount; ++i) {
+                int rowsCleared = stepBoard(&boards[i]);
+                if (rowsCleared >= 0) {
+                    recordPieceLocked(&telemetry, rowsCleared);
+                }
             }
+            ++telemetry.data.ticks;
+            accumulator -= 1000. / FPS;
         }
-    }
-}
 
-void convertPieceToStatic(SDL_Rect pieceBounds,
-                          int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH],
-                          int currentColor) {
-    for (int i = pieceBounds.y; i < getMaxBottomBound(pieceBounds); ++i) {
-        for (int j = pieceBounds.x; j < getMaxRightBound(pieceBounds); ++j) {
-            if (playfield[i][j] == CURRENT_PIECE_NUMBER) {
-                playfield[i][j] = currentColor;
+        setAllocationPhase(AllocationPhase_Render);
+        Uint64 renderStart = SDL_GetPerformanceCounter();
+
+        /* Lay the boards out in as many columns as fit the window */
+        float boardWidth = PLAYFIELD_WIDTH * squareWidth;
+        float boardHeight = (PLAYFIELD_HEIGHT - 1) * squareWidth;
+        int cellWidth = (int)boardWidth + SPECTATOR_GAP;
+        int cellHeight = (int)boardHeight + SPECTATOR_GAP;
+        int columns = max(1, (WINDOW_WIDTH - SPECTATOR_GAP) / cellWidth);
+        int rows = (boardCount + columns - 1) / columns;
+
+        int maxScroll =
+            max(0, rows * cellHeight + SPECTATOR_GAP - WINDOW_HEIGHT);
+        scrollY = scrollY < 0 ? 0 : scrollY > maxScroll ? maxScroll : scrollY;
+
+        /* Only rows that overlap the window make it into the vertex buffer */
+        int firstRow = scrollY / cellHeight;
+        int lastRow = (scrollY + WINDOW_HEIGHT) / cellHeight;
+        if (lastRow >= rows) {
+            lastRow = rows - 1;
+        }
+
+        int vertexCount = 0;
+        for (int row = firstRow; row <= lastRow; ++row) {
+            for (int column = 0; column < columns; ++column) {
+                int index = row * columns + column;
+                if (index >= boardCount) {
+                    break;
+                }
+                appendBoardGeometry(
+                    vertices, &vertexCount, &boards[index],
+                    SPECTATOR_GAP + column * cellWidth,
+                    SPECTATOR_GAP + row * cellHeight - scrollY, squareWidth);
+                ++boardsDrawn;
             }
         }
+
+        SDL_SetRenderDrawColor(renderer, BACKGROUND.r, BACKGROUND.g,
+                               BACKGROUND.b, BACKGROUND.a);
+        SDL_RenderClear(renderer);
+        /* Every visible square of every visible board in one call */
+        SDL_RenderGeometry(renderer, NULL, vertices, vertexCount, NULL, 0);
+        SDL_RenderPresent(renderer);
+
+        renderTicks += SDL_GetPerformanceCounter() - renderStart;
+        ++framesRendered;
+        ++telemetry.data.frames;
+        publishTelemetry(&telemetry, SDL_GetTicks());
+        endAllocationFrame();
+        if (framesRendered == frameLimit) {
+            quit = true;
+        }
+    }
+    closeTelemetry(&telemetry);
+
+    double elapsedSeconds = (currentTime - startTime) / 1000.;
+    double renderMs = renderTicks * 1000. / SDL_GetPerformanceFrequency();
+    printf("Boards simulated: %d\n", boardCount);
+    printf("Overall FPS: %f\n", framesRendered / elapsedSeconds);
+    printf("Average render time: %f ms/frame\n",
+           framesRendered ? renderMs / framesRendered : 0);
+    printf("Average render cost: %f us/board\n",
+           boardsDrawn ? renderMs * 1000. / boardsDrawn : 0);
+
+    for (int i = 0; i < boardCount; ++i) {
+        destroyPlayfield(&boards[i].playfield);
     }
+    free(vertices);
+    free(boards);
+    return framesRendered;
 }
 
-int clearEmptyRows(int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH]) {
-    int rowsCleared = 0;
-    int emptyRows[4]; /* Can only clear up to 4 rows */
+void resetBoard(Board *board) {
+    Playfield *playfield = &board->playfield;
+    memset(playfield->cells, 0,
+           (size_t)playfield->width * playfield->height * sizeof(int));
+    board->score = 0;
+    spawnBoardPiece(board);
+}
 
-    for (int i = 0; i < 4; ++i) {
-        emptyRows[i] = -1;
+void spawnBoardPiece(Board *board) {
+    if (!spawnRandomPiece(&board->playfield, &board->pieceBounds,
+                          &board->currentColor, &board->pieceIndex)) {
+        /* Game over, just start again */
+        resetBoard(board);
+        return;
     }
+    board->rotationIndex = 0;
+    board->framesSinceLastFall = 0;
+    board->rotationsLeft = rand() % 4;
+    board->shiftsLeft = rand() % 9 - 4;
+}
 
-    for (int i = 1; i < PLAYFIELD_HEIGHT; ++i) {
-        bool hasZero = false;
-        for (int j = 0; j < PLAYFIELD_WIDTH; ++j) {
-            if (playfield[i][j] == 0) {
-                hasZero = true;
-                break;
-            }
+/* Returns how many rows the piece cleared if it locked, otherwise -1 */
+int stepBoard(Board *board) {
+    /* Very dumb bot: rotate and shift a random amount, then let it fall */
+    if (board->rotationsLeft > 0) {
+        if (canRotatePiece(board->pieceBounds, &board->playfield,
+                           board->pieceIndex, &board->rotationIndex)) {
+            rotatePiece(&board->pieceBounds, &board->playfield,
+                        board->pieceIndex, &board->rotationIndex);
         }
-        if (!hasZero) {
-            /* If the row has no zeros, clear it */
-            for (int j = 0; j < PLAYFIELD_WIDTH; ++j) {
-                playfield[i][j] = 0;
-            }
-
-            emptyRows[rowsCleared++] = i;
+        --board->rotationsLeft;
+    } else if (board->shiftsLeft < 0) {
+        if (canMoveInDirection(board->pieceBounds, &board->playfield,
+                               Direction_Left)) {
+            movePieceLeft(&board->pieceBounds, &board->playfield);
+            ++board->shiftsLeft;
+        } else {
+            board->shiftsLeft = 0;
+        }
+    } else if (board->shiftsLeft > 0) {
+        if (canMoveInDirection(board->pieceBounds, &board->playfield,
+                               Direction_Right)) {
+            movePieceRight(&board->pieceBounds, &board->playfield);
+            --board->shiftsLeft;
+        } else {
+            board->shiftsLeft = 0;
         }
     }
 
-    int offset = 0;
-    for (int i = rowsCleared - 1; i >= 0; --i) {
-        shiftAllRowsDown(playfield, emptyRows[i] + offset);
-        ++offset;
+    if (++board->framesSinceLastFall <= SPECTATOR_FRAMES_TO_FALL) {
+        return -1;
+    }
+    board->framesSinceLastFall = 0;
+
+    if (canMoveInDirection(board->pieceBounds, &board->playfield,
+                           Direction_Down)) {
+        dropPieceOneRow(&board->pieceBounds, &board->playfield);
+        return -1;
     }
 
+    convertPieceToStatic(board->pieceBounds, &board->playfield,
+                         board->currentColor);
+    int rowsCleared = clearEmptyRows(&board->playfield);
+    board->score += scoreForRowsCleared(rowsCleared);
+    spawnBoardPiece(board);
     return rowsCleared;
 }
 
-void shiftAllRowsDown(int playfield[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH],
-                      int end) {
-    for (int i = end; i >= 1; --i) {
-        for (int j = 0; j < PLAYFIELD_WIDTH; ++j) {
-            playfield[i][j] = playfield[i - 1][j];
-        }
+void appendQuad(SDL_Vertex *vertices, int *vertexCount, float x, float y,
+                float w, float h, SDL_Color color) {
+    /* Two triangles, no index buffer */
+    const float corners[6][2] = {{x, y},     {x + w, y}, {x, y + h},
+                                 {x + w, y}, {x + w, y + h}, {x, y + h}};
+
+    for (int i = 0; i < 6; ++i) {
+        SDL_Vertex *vertex = &vertices[(*vertexCount)++];
+        vertex->position.x = corners[i][0];
+        vertex->position.y = corners[i][1];
+        vertex->color = color;
+        vertex->tex_coord.x = vertex->tex_coord.y = 0;
     }
 }
 
-int scoreForRowsCleared(int rowsCleared) {
-    switch (rowsCleared) {
-        case 1:
-            return 100;
-        case 2:
-            return 300;
-        case 3:
-            return 500;
-        case 4:
-            return 800;
-        default:
-            return 0;
+void appendBoardGeometry(SDL_Vertex *vertices, int *vertexCount, Board *board,
+                         float x, float y, float squareWidth) {
+    const Playfield *playfield = &board->playfield;
+    int(*grid)[playfield->width] = (int(*)[playfield->width])playfield->cells;
+    const SDL_Color BLACK = {0, 0, 0, 255};
+    SDL_Color background = WHITE;
+    background.a = 255; /* Geometry colors are blended, unlike fill rects */
+    float w = playfield->width * squareWidth;
+    float h = (playfield->height - 1) * squareWidth;
+
+    /* Border then background, squares go on top */
+    appendQuad(vertices, vertexCount, x - 1, y - 1, w + 2, h + 2, BLACK);
+    appendQuad(vertices, vertexCount, x, y, w, h, background);
+
+    /* Leave a 1px gap between squares once they're big enough to see it */
+    float gap = squareWidth >= 4 ? 1 : 0;
+
+    for (int i = 0; i < playfield->height - 1; ++i) {
+        for (int j = 0; j < playfield->width; ++j) {
+            int currentSquare = grid[i + 1][j];
+            if (currentSquare == 0) {
+                continue;
+            }
+
+            SDL_Color color = currentSquare != CURRENT_PIECE_NUMBER
+                                  ? pieceColors[currentSquare]
+                                  : pieceColors[board->currentColor];
+            color.a = 255;
+            appendQuad(vertices, vertexCount, x + j * squareWidth + gap,
+                       y + i * squareWidth + gap, squareWidth - gap,
+                       squareWidth - gap, color);
+        }
     }
 }
@@ -0,0 +1,778 @@
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tetris.h"
+
+/* Finds a way to place a known queue of pieces so the board gets cleared
+ * (or a number of lines get cleared), for making puzzles. Pieces move the
+ * same way they do in the game: spawn where spawnRandomPiece puts them, then
+ * left, right, down and clockwise rotation in place, with no kicks. Anything
+ * a piece can reach and rest on is a placement, since lock delay gives the
+ * player time to slide and rotate along the stack.
+ *
+ * Boards are bitboards here rather than Playfields, so a collision check is a
+ * handful of ANDs instead of a walk over the piece box. */
+
+/* Bits to the left of column 0 that are always set, so a piece box hanging
+ * off the left edge still shifts into place and collides with the wall */
+#define WALL_BITS 4
+#define COLUMN_BITS (((1u << PLAYFIELD_WIDTH) - 1) << WALL_BITS)
+#define EMPTY_ROW (~COLUMN_BITS)
+#define FULL_ROW (~0u)
+
+#define MAX_QUEUE 32
+/* Every pose a piece could be in, bounds the reachability search */
+#define MAX_POSES (4 * PLAYFIELD_HEIGHT * (PLAYFIELD_WIDTH + 4))
+
+/* Seen boards, 32MB of fingerprints. Only boards that pass the pruning go
+ * in, a couple hundred thousand a pass for a 10 piece queue. */
+#define SEEN_TABLE_BITS 22
+#define SEEN_PROBES 32
+
+/* Root branches to hand out per thread, so a slow branch doesn't leave the
+ * others idle at the end */
+#define TASKS_PER_THREAD 32
+#define MAX_THREADS 256
+
+const char PIECE_LETTERS[] = "IJLOSTZ";
+
+typedef struct {
+    uint32_t rows[PLAYFIELD_HEIGHT]; /* Row 0 is the hidden spawn row */
+} Bitboard;
+
+typedef struct {
+    int x;
+    int y;
+    int rotation;
+} Pose;
+
+/* A board part way through the queue, and how it got there */
+typedef struct {
+    Bitboard board;
+    int depth; /* Pieces placed so far */
+    int lines;
+    Pose path[MAX_QUEUE];
+} SearchNode;
+
+typedef struct {
+    int queue[MAX_QUEUE];
+    int queueLength;
+    int targetLines; /* 0 means clear the whole board */
+    int depthLimit;  /* Pieces this pass may place, up to queueLength */
+
+    /* Root branches, taken by whichever thread gets to them first */
+    SearchNode *tasks;
+    int taskCount;
+    atomic_int nextTask;
+
+    /* Fingerprints of (board, depth, lines) already searched on this pass,
+     * open addressing with 0 as the empty slot */
+    _Atomic uint64_t *seen;
+
+    atomic_bool found;
+    atomic_uint_fast64_t nodes;
+    pthread_mutex_t solutionLock;
+    SearchNode solution;
+} Search;
+
+/* Piece rows as bitmasks, bit j is column j of the 4x4 box */
+uint32_t pieceMasks[7][4][4];
+
+void buildPieceMasks(void);
+bool loadPuzzle(const char *path, Bitboard *board, Search *search);
+bool parseQueue(const char *text, Search *search);
+bool collides(const Bitboard *board, int piece, Pose pose);
+Pose spawnPose(int piece);
+int findPlacements(const Bitboard *board, int piece, Pose *placements);
+int lockPiece(Bitboard *board, int piece, Pose pose);
+bool isBoardEmpty(const Bitboard *board);
+bool isGoal(const Search *search, const SearchNode *node);
+bool canStillReachGoal(const Search *search, const SearchNode *node);
+uint64_t fingerprint(const SearchNode *node);
+bool markSeen(Search *search, const SearchNode *node);
+int expandNode(Search *search, const SearchNode *node, SearchNode *children);
+void sortLowestFirst(Pose *placements, int placementCount);
+bool runSearch(Search *search, const Bitboard *start, int threadCount);
+void searchFrom(Search *search, const SearchNode *node, uint64_t *nodes);
+void *runWorker(void *argument);
+void recordSolution(Search *search, const SearchNode *node);
+void printSolution(const Bitboard *start, const Search *search);
+double secondsSince(struct timespec start);
+
+int main(int argc, char *argv[]) {
+    const char *puzzlePath = NULL;
+    const char *queueText = NULL;
+    int targetLines = 0;
+    int threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--queue") && i + 1 < argc) {
+            queueText = argv[++i];
+        } else if (!strcmp(argv[i], "--lines") && i + 1 < argc) {
+            targetLines = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threadCount = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && !puzzlePath) {
+            puzzlePath = argv[i];
+        } else {
+            puzzlePath = NULL;
+            break;
+        }
+    }
+    if (!puzzlePath || targetLines < 0 || threadCount < 1 ||
+        threadCount > MAX_THREADS) {
+        printf("Usage: %s PUZZLE [--queue PIECES] [--lines N] "
+               "[--threads N]\n"
+               "Threads go from 1 to %d\n",
+               argv[0], MAX_THREADS);
+        return 1;
+    }
+
+    buildPieceMasks();
+
+    Search search = {0};
+    Bitboard start;
+    if (!loadPuzzle(puzzlePath, &start, &search)) {
+        return 1;
+    }
+    if (queueText && !parseQueue(queueText, &search)) {
+        return 1;
+    }
+    if (search.queueLength == 0) {
+        printf("No piece queue, give one in the puzzle or with --queue\n");
+        return 1;
+    }
+    search.targetLines = targetLines;
+
+    pthread_mutex_init(&search.solutionLock, NULL);
+
+    struct timespec startTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+    /* Shortest first: every extra piece the search is allowed multiplies
+     * its size, and fewer pieces left means more boards get pruned */
+    for (int depthLimit = 1;
+         depthLimit <= search.queueLength && !atomic_load(&search.found);
+         ++depthLimit) {
+        /* Most lengths can't work at all, in perfect clear mode only those
+         * where the board plus 4 squares a piece is a whole number of rows */
+        SearchNode root = {.board = start};
+        search.depthLimit = depthLimit;
+        if (!canStillReachGoal(&search, &root)) {
+            continue;
+        }
+
+        /* A fresh table every pass, boards from a shorter one would just be
+         * in the way. Fresh pages from calloc only get zeroed as they're
+         * touched, so small passes don't pay for clearing all of it. */
+        free(search.seen);
+        search.seen = calloc((size_t)1 << SEEN_TABLE_BITS, sizeof(uint64_t));
+        if (!search.seen) {
+            printf("Couldn't allocate the seen table!\n");
+            return 1;
+        }
+
+        if (!runSearch(&search, &start, threadCount)) {
+            printf("Couldn't allocate the search!\n");
+            return 1;
+        }
+    }
+
+    double elapsed = secondsSince(startTime);
+    uint64_t nodes = atomic_load(&search.nodes);
+
+    bool found = atomic_load(&search.found);
+    if (found) {
+        printSolution(&start, &search);
+    } else {
+        printf("No solution\n");
+    }
+    printf("Nodes: %llu in %f s (%.0f nodes/s on %d threads)\n",
+           (unsigned long long)nodes, elapsed,
+           elapsed > 0 ? nodes / elapsed : 0, threadCount);
+
+    free(search.seen);
+    pthread_mutex_destroy(&search.solutionLock);
+    return found ? 0 : 2;
+}
+
+void buildPieceMasks(void) {
+    for (int piece = 0; piece < 7; ++piece) {
+        for (int rotation = 0; rotation < 4; ++rotation) {
+            for (int i = 0; i < 4; ++i) {
+                uint32_t mask = 0;
+                for (int j = 0; j < 4; ++j) {
+                    if (pieceRotations[piece][rotation][i][j]) {
+                        mask |= 1u << j;
+                    }
+                }
+                pieceMasks[piece][rotation][i] = mask;
+            }
+        }
+    }
+}
+
+bool loadPuzzle(const char *path, Bitboard *board, Search *search) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("Couldn't open %s\n", path);
+        return false;
+    }
+
+    /* Rows are read top to bottom and then lined up with the bottom of the
+     * board, so a puzzle only needs the rows that have something in them */
+    uint32_t rows[PLAYFIELD_HEIGHT];
+    int rowCount = 0;
+    char line[256];
+    int lineNumber = 0;
+    bool ok = true;
+
+    while (ok && fgets(line, sizeof(line), file)) {
+        ++lineNumber;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0') {
+            continue;
+        }
+        if (!strncmp(line, "queue:", 6)) {
+            ok = parseQueue(line + 6, search);
+            continue;
+        }
+
+        if (strlen(line) != PLAYFIELD_WIDTH) {
+            printf("%s:%d: rows have to be %d wide\n", path, lineNumber,
+                   PLAYFIELD_WIDTH);
+            ok = false;
+        } else if (rowCount == PLAYFIELD_HEIGHT) {
+            printf("%s:%d: more than %d rows\n", path, lineNumber,
+                   PLAYFIELD_HEIGHT);
+            ok = false;
+        } else {
+            /* Same as the int[][] cells: 0 is empty, anything else isn't */
+            uint32_t row = EMPTY_ROW;
+            for (int j = 0; j < PLAYFIELD_WIDTH; ++j) {
+                if (line[j] != '0' && line[j] != '.' && line[j] != ' ') {
+                    row |= 1u << (j + WALL_BITS);
+                }
+            }
+            rows[rowCount++] = row;
+        }
+    }
+    fclose(file);
+
+    for (int i = 0; i < PLAYFIELD_HEIGHT; ++i) {
+        int row = i - (PLAYFIELD_HEIGHT - rowCount);
+        board->rows[i] = row >= 0 ? rows[row] : EMPTY_ROW;
+    }
+    return ok;
+}
+
+bool parseQueue(const char *text, Search *search) {
+    search->queueLength = 0;
+    for (; *text; ++text) {
+        if (isspace((unsigned char)*text) || *text == ',') {
+            continue;
+        }
+        const char *letter = strchr(PIECE_LETTERS, toupper(*text));
+        if (!letter) {
+            printf("Unknown piece '%c' in queue, use %s\n", *text,
+                   PIECE_LETTERS);
+            return false;
+        }
+        if (search->queueLength == MAX_QUEUE) {
+            printf("Queue is longer than %d pieces\n", MAX_QUEUE);
+            return false;
+        }
+        search->queue[search->queueLength++] = (int)(letter - PIECE_LETTERS);
+    }
+    return true;
+}
+
+bool collides(const Bitboard *board, int piece, Pose pose) {
+    const uint32_t *masks = pieceMasks[piece][pose.rotation];
+
+    for (int i = 0; i < 4; ++i) {
+        if (!masks[i]) {
+            continue;
+        }
+        int row = pose.y + i;
+        if (row >= PLAYFIELD_HEIGHT ||
+            board->rows[row] & (masks[i] << (pose.x + WALL_BITS))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Pose spawnPose(int piece) {
+    /* Where spawnRandomPiece puts it */
+    Pose pose = {(PLAYFIELD_WIDTH - 4) / 2 + pieceOffsets[piece][1],
+                 pieceOffsets[piece][0] + 1, 0};
+    return pose;
+}
+
+int findPlacements(const Bitboard *board, int piece, Pose *placements) {
+    /* Breadth first over every pose the piece can get to, bit x + 4 of
+     * visited[rotation][y] is set once (x, y, rotation) has been queued */
+    uint32_t visited[4][PLAYFIELD_HEIGHT] = {{0}};
+    Pose queue[MAX_POSES];
+    uint64_t footprints[MAX_POSES];
+    int head = 0;
+    int tail = 0;
+    int placementCount = 0;
+
+    Pose spawn = spawnPose(piece);
+    if (collides(board, piece, spawn)) {
+        return 0; /* Game over */
+    }
+
+    /* Above the stack the piece can get to any rotation and column, so
+     * start the search from every one of those just above it rather than
+     * walking down there from the spawn */
+    int top = 0;
+    while (top < PLAYFIELD_HEIGHT && board->rows[top] == EMPTY_ROW) {
+        ++top;
+    }
+    int startRow = max(spawn.y, top - 4);
+    for (int rotation = 0; rotation < 4; ++rotation) {
+        for (int x = -3; x < PLAYFIELD_WIDTH; ++x) {
+            Pose pose = {x, startRow, rotation};
+            if (startRow == spawn.y &&
+                (x != spawn.x || rotation != spawn.rotation)) {
+                continue; /* Still in the spawn rows, search normally */
+            }
+            if (!collides(board, piece, pose)) {
+                visited[rotation][startRow] |= 1u << (x + WALL_BITS);
+                queue[tail++] = pose;
+            }
+        }
+    }
+
+    while (head < tail) {
+        Pose pose = queue[head++];
+        const Pose moves[4] = {
+            {pose.x - 1, pose.y, pose.rotation},
+            {pose.x + 1, pose.y, pose.rotation},
+            {pose.x, pose.y + 1, pose.rotation},
+            {pose.x, pose.y, (pose.rotation + 1) % 4},
+        };
+
+        for (int i = 0; i < 4; ++i) {
+            uint32_t bit = 1u << (moves[i].x + WALL_BITS);
+            if (visited[moves[i].rotation][moves[i].y] & bit ||
+                collides(board, piece, moves[i])) {
+                continue;
+            }
+            visited[moves[i].rotation][moves[i].y] |= bit;
+            queue[tail++] = moves[i];
+        }
+
+        if (!collides(board, piece, moves[2])) {
+            continue; /* Not resting on anything */
+        }
+
+        /* Some rotations fill the same squares (all of O's, two of I's), only
+         * keep one of each. Rows are WIDTH bits so four of them and the top
+         * row fit in 64. */
+        const uint32_t *masks = pieceMasks[piece][pose.rotation];
+        int firstRow = 0;
+        while (!masks[firstRow]) {
+            ++firstRow;
+        }
+        uint64_t footprint = pose.y + firstRow;
+        for (int i = firstRow; i < 4; ++i) {
+            uint64_t row = (masks[i] << (pose.x + WALL_BITS)) >> WALL_BITS;
+            footprint |= row << (5 + (i - firstRow) * PLAYFIELD_WIDTH);
+        }
+        bool duplicate = false;
+        for (int i = 0; i < placementCount && !duplicate; ++i) {
+            duplicate = footprints[i] == footprint;
+        }
+        if (!duplicate) {
+            footprints[placementCount] = footprint;
+            placements[placementCount++] = pose;
+        }
+    }
+
+    return placementCount;
+}
+
+int lockPiece(Bitboard *board, int piece, Pose pose) {
+    const uint32_t *masks = pieceMasks[piece][pose.rotation];
+    for (int i = 0; i < 4; ++i) {
+        if (masks[i]) {
+            board->rows[pose.y + i] |= masks[i] << (pose.x + WALL_BITS);
+        }
+    }
+
+    /* Same as clearEmptyRows, the hidden row never counts as full */
+    int rowsCleared = 0;
+    for (int i = PLAYFIELD_HEIGHT - 1; i >= 0; --i) {
+        if (i > 0 && board->rows[i] == FULL_ROW) {
+            ++rowsCleared;
+        } else if (rowsCleared) {
+            board->rows[i + rowsCleared] = board->rows[i];
+        }
+    }
+    for (int i = 0; i < rowsCleared; ++i) {
+        board->rows[i] = EMPTY_ROW;
+    }
+    return rowsCleared;
+}
+
+bool isBoardEmpty(const Bitboard *board) {
+    for (int i = 0; i < PLAYFIELD_HEIGHT; ++i) {
+        if (board->rows[i] != EMPTY_ROW) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool isGoal(const Search *search, const SearchNode *node) {
+    if (search->targetLines > 0) {
+        return node->lines >= search->targetLines;
+    }
+    return node->depth > 0 && isBoardEmpty(&node->board);
+}
+
+bool canStillReachGoal(const Search *search, const SearchNode *node) {
+    int filled = 0;
+    int height = 0;
+    int rowsBySquares[PLAYFIELD_WIDTH + 1] = {0};
+    for (int i = 0; i < PLAYFIELD_HEIGHT; ++i) {
+        int squares = __builtin_popcount(node->board.rows[i] & COLUMN_BITS);
+        if (squares && !height) {
+            height = PLAYFIELD_HEIGHT - i;
+        }
+        filled += squares;
+        ++rowsBySquares[squares];
+    }
+    int squaresLeft = 4 * (search->depthLimit - node->depth);
+
+    /* Every line still to clear needs its row topped up, so even filling
+     * only the fullest rows has to fit in the pieces we have left */
+    if (search->targetLines > 0) {
+        int linesLeft = search->targetLines - node->lines;
+        int squaresNeeded = 0;
+        for (int squares = PLAYFIELD_WIDTH; squares >= 0 && linesLeft > 0;
+             --squares) {
+            int rows = min(rowsBySquares[squares], linesLeft);
+            squaresNeeded += rows * (PLAYFIELD_WIDTH - squares);
+            linesLeft -= rows;
+        }
+        return squaresNeeded <= squaresLeft;
+    }
+
+    /* Clearing the board means clearing at least every row that has
+     * something in it. Shorter queues were all tried on earlier passes, so
+     * it takes every piece left, and they have to fill those rows exactly. */
+    int squares = filled + squaresLeft;
+    int rowsLeft = squares / PLAYFIELD_WIDTH;
+    if (squares % PLAYFIELD_WIDTH != 0 || rowsLeft < height) {
+        return false;
+    }
+
+    /* More rows to clear than the board holds means some get built from
+     * scratch above it, which the grouping below can't account for */
+    if (rowsLeft > PLAYFIELD_HEIGHT - 1) {
+        return true;
+    }
+
+    /* Squares get filled by whole pieces, so wherever the empty ones split
+     * into areas no piece can span, each area has to come in fours. Clears
+     * can join empty squares above and below them in a column, so a column
+     * is never split, and next door columns are joined if any row (up to
+     * the last one to clear) has both empty. */
+    uint32_t joined = 0;
+    for (int i = PLAYFIELD_HEIGHT - rowsLeft; i < PLAYFIELD_HEIGHT; ++i) {
+        uint32_t empty = ~node->board.rows[i] & COLUMN_BITS;
+        joined |= empty & (empty >> 1);
+    }
+    uint32_t region = 0;
+    for (int column = 0; column < PLAYFIELD_WIDTH; ++column) {
+        uint32_t bit = 1u << (column + WALL_BITS);
+        region |= bit;
+        if (joined & bit) {
+            continue;
+        }
+        int empty = 0;
+        for (int i = PLAYFIELD_HEIGHT - rowsLeft; i < PLAYFIELD_HEIGHT; ++i) {
+            empty += __builtin_popcount(~node->board.rows[i] & region);
+        }
+        if (empty % 4 != 0) {
+            return false;
+        }
+        region = 0;
+    }
+    return true;
+}
+
+uint64_t fingerprint(const SearchNode *node) {
+    /* FNV-1a over the rows. Two different boards sharing a fingerprint is
+     * possible but unlikely enough at 64 bits that we live with it. */
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < PLAYFIELD_HEIGHT; ++i) {
+        hash = (hash ^ node->board.rows[i]) * 1099511628211ull;
+    }
+    hash = (hash ^ (uint64_t)node->depth) * 1099511628211ull;
+    hash = (hash ^ (uint64_t)node->lines) * 1099511628211ull;
+    return hash ? hash : 1; /* 0 marks an empty slot */
+}
+
+/* Returns false if the board was already searched (or is being searched by
+ * another thread) */
+bool markSeen(Search *search, const SearchNode *node) {
+    uint64_t hash = fingerprint(node);
+    uint64_t mask = ((uint64_t)1 << SEEN_TABLE_BITS) - 1;
+
+    for (int probe = 0; probe < SEEN_PROBES; ++probe) {
+        _Atomic uint64_t *slot = &search->seen[(hash + probe) & mask];
+        uint64_t current = atomic_load_explicit(slot, memory_order_relaxed);
+        if (current == hash) {
+            return false;
+        }
+        if (current == 0 &&
+            atomic_compare_exchange_strong_explicit(
+                slot, &current, hash, memory_order_relaxed,
+                memory_order_relaxed)) {
+            return true;
+        }
+        if (current == hash) { /* Another thread beat us to this slot */
+            return false;
+        }
+    }
+
+    /* Table is too full here, searching it twice is slower but still right */
+    return true;
+}
+
+/* Writes every new board one piece on from node, returns how many */
+int expandNode(Search *search, const SearchNode *node, SearchNode *children) {
+    Pose placements[MAX_POSES];
+    int piece = search->queue[node->depth];
+    int placementCount = findPlacements(&node->board, piece, placements);
+    int childCount = 0;
+
+    for (int i = 0; i < placementCount; ++i) {
+        SearchNode *child = &children[childCount];
+        *child = *node;
+        child->lines += lockPiece(&child->board, piece, placements[i]);
+        child->path[child->depth++] = placements[i];
+        if (markSeen(search, child)) {
+            ++childCount;
+        }
+    }
+    return childCount;
+}
+
+/* Low placements leave flatter boards, which is where solutions usually are,
+ * so they get tried first */
+void sortLowestFirst(Pose *placements, int placementCount) {
+    for (int i = 1; i < placementCount; ++i) {
+        Pose pose = placements[i];
+        int j = i;
+        for (; j > 0 && placements[j - 1].y < pose.y; --j) {
+            placements[j] = placements[j - 1];
+        }
+        placements[j] = pose;
+    }
+}
+
+/* One pass at search->depthLimit */
+bool runSearch(Search *search, const Bitboard *start, int threadCount) {
+    /* Breadth first from the start until there are enough branches to go
+     * around, then every thread takes branches depth first */
+    SearchNode *level = malloc(sizeof(SearchNode));
+    if (!level) {
+        return false;
+    }
+    level[0] = (SearchNode){.board = *start};
+    markSeen(search, &level[0]);
+    int levelCount = 1;
+    int wantedTasks = threadCount * TASKS_PER_THREAD;
+    uint64_t nodes = 0;
+
+    while (levelCount < wantedTasks && !atomic_load(&search->found)) {
+        SearchNode *next = NULL;
+        int nextCount = 0;
+        int nextCapacity = 0;
+        for (int i = 0; i < levelCount && !atomic_load(&search->found); ++i) {
+            if (isGoal(search, &level[i])) {
+                recordSolution(search, &level[i]);
+                break;
+            }
+            if (level[i].depth == search->depthLimit ||
+                !canStillReachGoal(search, &level[i])) {
+                continue;
+            }
+            if (nextCount + MAX_POSES > nextCapacity) {
+                nextCapacity = 2 * nextCapacity + MAX_POSES;
+                SearchNode *grown =
+                    realloc(next, nextCapacity * sizeof(SearchNode));
+                if (!grown) {
+                    free(next);
+                    free(level);
+                    return false;
+                }
+                next = grown;
+            }
+            int childCount = expandNode(search, &level[i], &next[nextCount]);
+            nodes += childCount;
+            nextCount += childCount;
+        }
+
+        free(level);
+        level = next;
+        levelCount = nextCount;
+        if (levelCount == 0) {
+            break;
+        }
+    }
+    atomic_fetch_add(&search->nodes, nodes);
+
+    search->tasks = level;
+    search->taskCount = levelCount;
+    atomic_store(&search->nextTask, 0);
+    pthread_t threads[threadCount];
+    int started = 0;
+    for (int i = 0; i < threadCount; ++i) {
+        if (pthread_create(&threads[started], NULL, runWorker, search) == 0) {
+            ++started;
+        }
+    }
+    /* Out of threads, the ones that did start share the work and if none
+     * did it all happens here */
+    if (started == 0) {
+        runWorker(search);
+    }
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(level);
+    search->tasks = NULL;
+    return true;
+}
+
+void searchFrom(Search *search, const SearchNode *node, uint64_t *nodes) {
+    if (atomic_load_explicit(&search->found, memory_order_relaxed)) {
+        return;
+    }
+    if (isGoal(search, node)) {
+        recordSolution(search, node);
+        return;
+    }
+    if (node->depth == search->depthLimit ||
+        !canStillReachGoal(search, node)) {
+        return;
+    }
+
+    /* Children are worked out one at a time, a whole level of SearchNodes
+     * per call would be too much stack for deep queues */
+    Pose placements[MAX_POSES];
+    int piece = search->queue[node->depth];
+    int placementCount = findPlacements(&node->board, piece, placements);
+    sortLowestFirst(placements, placementCount);
+
+    for (int i = 0; i < placementCount; ++i) {
+        SearchNode child = *node;
+        child.lines += lockPiece(&child.board, piece, placements[i]);
+        child.path[child.depth++] = placements[i];
+        ++*nodes;
+        /* Dead ends don't need to take up room in the seen table */
+        if ((isGoal(search, &child) || canStillReachGoal(search, &child)) &&
+            markSeen(search, &child)) {
+            searchFrom(search, &child, nodes);
+        }
+    }
+}
+
+void *runWorker(void *argument) {
+    Search *search = argument;
+    uint64_t nodes = 0;
+
+    while (!atomic_load_explicit(&search->found, memory_order_relaxed)) {
+        int task = atomic_fetch_add(&search->nextTask, 1);
+        if (task >= search->taskCount) {
+            break;
+        }
+        searchFrom(search, &search->tasks[task], &nodes);
+    }
+
+    atomic_fetch_add(&search->nodes, nodes);
+    return NULL;
+}
+
+void recordSolution(Search *search, const SearchNode *node) {
+    pthread_mutex_lock(&search->solutionLock);
+    if (!atomic_load(&search->found)) {
+        search->solution = *node;
+        atomic_store(&search->found, true);
+    }
+    pthread_mutex_unlock(&search->solutionLock);
+}
+
+void printSolution(const Bitboard *start, const Search *search) {
+    /* Replayed on letters so each step shows which piece went where */
+    char grid[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH + 1];
+    for (int i = 0; i < PLAYFIELD_HEIGHT; ++i) {
+        for (int j = 0; j < PLAYFIELD_WIDTH; ++j) {
+            grid[i][j] = start->rows[i] & (1u << (j + WALL_BITS)) ? '#' : '.';
+        }
+        grid[i][PLAYFIELD_WIDTH] = '\0';
+    }
+
+    const SearchNode *solution = &search->solution;
+    for (int step = 0; step < solution->depth; ++step) {
+        int piece = search->queue[step];
+        Pose pose = solution->path[step];
+        printf("%d: %c rotation %d at x %d y %d\n", step + 1,
+               PIECE_LETTERS[piece], pose.rotation, pose.x, pose.y);
+
+        const uint32_t *masks = pieceMasks[piece][pose.rotation];
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                if (masks[i] & (1u << j)) {
+                    grid[pose.y + i][pose.x + j] = PIECE_LETTERS[piece];
+                }
+            }
+        }
+
+        /* Show the board with the piece in it, before any lines clear,
+         * from the highest square down (at least 4 rows) */
+        int top = PLAYFIELD_HEIGHT - 4;
+        for (int i = 0; i < top; ++i) {
+            if (strspn(grid[i], ".") < PLAYFIELD_WIDTH) {
+                top = i;
+            }
+        }
+        for (int i = top; i < PLAYFIELD_HEIGHT; ++i) {
+            printf("    %.*s\n", PLAYFIELD_WIDTH, grid[i]);
+        }
+
+        int rowsCleared = 0;
+        for (int i = PLAYFIELD_HEIGHT - 1; i >= 0; --i) {
+            if (i > 0 && !memchr(grid[i], '.', PLAYFIELD_WIDTH)) {
+                ++rowsCleared;
+            } else if (rowsCleared) {
+                memcpy(grid[i + rowsCleared], grid[i], PLAYFIELD_WIDTH);
+            }
+        }
+        for (int i = 0; i < rowsCleared; ++i) {
+            memset(grid[i], '.', PLAYFIELD_WIDTH);
+        }
+    }
+}
+
+double secondsSince(struct timespec start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
@@ -0,0 +1,177 @@
+#include "telemetry.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define HAVE_SHARED_MEMORY
+#endif
+
+bool openTelemetry(Telemetry *telemetry, const char *kind) {
+    memset(telemetry, 0, sizeof(*telemetry));
+
+#ifdef HAVE_SHARED_MEMORY
+    snprintf(telemetry->name, sizeof(telemetry->name), "/%s%d",
+             TELEMETRY_PREFIX, (int)getpid());
+
+    int fd = shm_open(telemetry->name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, sizeof(TelemetrySegment)) < 0) {
+        close(fd);
+        shm_unlink(telemetry->name);
+        return false;
+    }
+
+    void *memory = mmap(NULL, sizeof(TelemetrySegment),
+                        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        shm_unlink(telemetry->name);
+        return false;
+    }
+
+    TelemetrySegment *segment = memory;
+    segment->version = TELEMETRY_VERSION;
+    segment->pid = getpid();
+    snprintf(segment->kind, sizeof(segment->kind), "%s", kind);
+    atomic_store_explicit(&segment->sequence, 0, memory_order_relaxed);
+
+    /* Magic goes in last so readers never see a half set up header */
+    atomic_thread_fence(memory_order_release);
+    segment->magic = TELEMETRY_MAGIC;
+
+    telemetry->segment = segment;
+    return true;
+#else
+    (void)kind;
+    return false;
+#endif
+}
+
+void closeTelemetry(Telemetry *telemetry) {
+#ifdef HAVE_SHARED_MEMORY
+    if (telemetry->segment) {
+        munmap(telemetry->segment, sizeof(TelemetrySegment));
+        shm_unlink(telemetry->name);
+        telemetry->segment = NULL;
+    }
+#endif
+}
+
+static int bucketFor(double milliseconds) {
+    int bucket = (int)(milliseconds / TELEMETRY_BUCKET_MS);
+    if (bucket < 0) {
+        return 0;
+    }
+    return bucket < TELEMETRY_BUCKETS ? bucket : TELEMETRY_BUCKETS - 1;
+}
+
+void recordFrameTime(Telemetry *telemetry, double milliseconds) {
+    ++telemetry->frameTimes[bucketFor(milliseconds)];
+    if (milliseconds > telemetry->frameTimeMax) {
+        telemetry->frameTimeMax = milliseconds;
+    }
+}
+
+void recordInputLatency(Telemetry *telemetry, double milliseconds) {
+    ++telemetry->inputLatencies[bucketFor(milliseconds)];
+}
+
+void recordPieceLocked(Telemetry *telemetry, int rowsCleared) {
+    ++telemetry->data.piecesLocked;
+    if (rowsCleared >= 0 && rowsCleared <= 4) {
+        ++telemetry->data.linesCleared[rowsCleared];
+    }
+}
+
+void publishTelemetry(Telemetry *telemetry, double now) {
+    if (!telemetry->segment ||
+        now - telemetry->lastPublish < TELEMETRY_PUBLISH_INTERVAL_MS) {
+        return;
+    }
+    telemetry->lastPublish = now;
+
+    /* Percentiles cover the interval since the last publish */
+    TelemetryData *data = &telemetry->data;
+    data->publishedAt = now;
+    data->frameTimeP50 = histogramPercentile(telemetry->frameTimes, 0.5);
+    data->frameTimeP99 = histogramPercentile(telemetry->frameTimes, 0.99);
+    data->frameTimeMax = telemetry->frameTimeMax;
+    /* Most intervals have no key presses at all, those keep showing the
+     * last latency instead of dropping to 0 */
+    double latencyP50 = histogramPercentile(telemetry->inputLatencies, 0.5);
+    if (latencyP50 > 0) {
+        data->inputLatencyP50 = latencyP50;
+        data->inputLatencyP99 =
+            histogramPercentile(telemetry->inputLatencies, 0.99);
+    }
+    memset(telemetry->frameTimes, 0, sizeof(telemetry->frameTimes));
+    memset(telemetry->inputLatencies, 0, sizeof(telemetry->inputLatencies));
+    telemetry->frameTimeMax = 0;
+
+    /* Odd sequence while writing, readers that saw it (or saw it change)
+     * throw away what they copied and try again */
+    TelemetrySegment *segment = telemetry->segment;
+    uint32_t sequence =
+        atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+    atomic_store_explicit(&segment->sequence, sequence + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&segment->data, data, sizeof(*data));
+    atomic_store_explicit(&segment->sequence, sequence + 2,
+                          memory_order_release);
+}
+
+bool readTelemetry(const TelemetrySegment *segment, TelemetryData *data) {
+    if (segment->magic != TELEMETRY_MAGIC ||
+        segment->version != TELEMETRY_VERSION) {
+        return false;
+    }
+
+    /* Updates are quick and rare, so this only loops if we're very unlucky */
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+        uint32_t before = atomic_load_explicit(
+            (_Atomic uint32_t *)&segment->sequence, memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+
+        memcpy(data, &segment->data, sizeof(*data));
+        atomic_thread_fence(memory_order_acquire);
+
+        uint32_t after = atomic_load_explicit(
+            (_Atomic uint32_t *)&segment->sequence, memory_order_relaxed);
+        if (before == after) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+double histogramPercentile(const uint32_t histogram[TELEMETRY_BUCKETS],
+                           double percentile) {
+    uint64_t total = 0;
+    for (int i = 0; i < TELEMETRY_BUCKETS; ++i) {
+        total += histogram[i];
+    }
+    if (!total) {
+        return 0;
+    }
+
+    /* Upper edge of the bucket the percentile falls in */
+    uint64_t target = (uint64_t)(percentile * total);
+    uint64_t seen = 0;
+    for (int i = 0; i < TELEMETRY_BUCKETS; ++i) {
+        seen += histogram[i];
+        if (seen > target) {
+            return (i + 1) * TELEMETRY_BUCKET_MS;
+        }
+    }
+    return TELEMETRY_BUCKETS * TELEMETRY_BUCKET_MS;
+}
@@ -0,0 +1,76 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+/* Live counters published to shared memory so tetris-top can watch running
+ * games without stopping them. Each process gets its own segment (named
+ * /tetris-telemetry-<pid>), which has a single writer and any number of
+ * readers. Readers never block the game: the writer bumps a sequence number
+ * around every update and readers retry if it changed under them (a
+ * seqlock). */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TELEMETRY_PREFIX "tetris-telemetry-"
+#define TELEMETRY_MAGIC 0x59544554 /* "TETY" */
+#define TELEMETRY_VERSION 1
+
+/* Histograms for the percentiles, 0.25ms buckets up to 64ms (anything slower
+ * lands in the last one) */
+#define TELEMETRY_BUCKETS 256
+#define TELEMETRY_BUCKET_MS 0.25
+
+/* What readers get, copied out whole under the seqlock */
+typedef struct {
+    uint64_t publishedAt; /* Milliseconds since the process started */
+    uint64_t ticks;
+    uint64_t frames;
+    uint64_t piecesLocked;
+    uint64_t linesCleared[5]; /* By clear size, [4] is tetrises */
+    int32_t level;
+    int32_t boards; /* More than one for the spectator wall */
+    /* Over the last publish interval, in milliseconds */
+    double frameTimeP50;
+    double frameTimeP99;
+    double frameTimeMax;
+    /* Over the last interval that had any key presses, 0 until the first */
+    double inputLatencyP50;
+    double inputLatencyP99;
+} TelemetryData;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid;
+    char kind[16]; /* "game" or "spectator" */
+    _Atomic uint32_t sequence; /* Odd while an update is being written */
+    TelemetryData data;
+} TelemetrySegment;
+
+typedef struct {
+    TelemetrySegment *segment; /* NULL if shared memory isn't available */
+    char name[64];
+    TelemetryData data; /* Updated freely, copied to the segment now and then */
+    uint32_t frameTimes[TELEMETRY_BUCKETS];
+    uint32_t inputLatencies[TELEMETRY_BUCKETS];
+    double frameTimeMax;
+    double lastPublish;
+} Telemetry;
+
+static const double TELEMETRY_PUBLISH_INTERVAL_MS = 250;
+
+/* Writing, from the game */
+bool openTelemetry(Telemetry *telemetry, const char *kind);
+void closeTelemetry(Telemetry *telemetry);
+void recordFrameTime(Telemetry *telemetry, double milliseconds);
+void recordInputLatency(Telemetry *telemetry, double milliseconds);
+void recordPieceLocked(Telemetry *telemetry, int rowsCleared);
+void publishTelemetry(Telemetry *telemetry, double now);
+
+/* Reading, from tetris-top */
+bool readTelemetry(const TelemetrySegment *segment, TelemetryData *data);
+double histogramPercentile(const uint32_t histogram[TELEMETRY_BUCKETS],
+                           double percentile);
+
+#endif
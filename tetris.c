@@ -0,0 +1,601 @@
+#include "tetris.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* clang-format off */
+const int pieceRotations[7][4][4][4] = {
+    /* I */
+    {
+        {
+            {0, 0, 1, 0,},
+            {0, 0, 1, 0,},
+            {0, 0, 1, 0,},
+            {0, 0, 1, 0,},
+        },
+        {
+            {0, 0, 0, 0,},
+            {1, 1, 1, 1,},
+            {0, 0, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {0, 0, 1, 0,},
+            {0, 0, 1, 0,},
+            {0, 0, 1, 0,},
+            {0, 0, 1, 0,},
+        },
+        {
+            {0, 0, 0, 0,},
+            {1, 1, 1, 1,},
+            {0, 0, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+    },
+    /* J */
+    {
+        {
+            {0, 0, 0, 0,},
+            {1, 1, 1, 0,},
+            {0, 0, 1, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {0, 1, 0, 0,},
+            {0, 1, 0, 0,},
+            {1, 1, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {1, 0, 0, 0,},
+            {1, 1, 1, 0,},
+            {0, 0, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {0, 1, 1, 0,},
+            {0, 1, 0, 0,},
+            {0, 1, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+    },
+    /* L */
+    {
+        {
+            {0, 0, 0, 0,},
+            {1, 1, 1, 0,},
+            {1, 0, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {1, 1, 0, 0,},
+            {0, 1, 0, 0,},
+            {0, 1, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {0, 0, 1, 0,},
+            {1, 1, 1, 0,},
+            {0, 0, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {0, 1, 0, 0,},
+            {0, 1, 0, 0,},
+            {0, 1, 1, 0,},
+            {0, 0, 0, 0,},
+        },
+    },
+    /* O */
+    {
+        {
+            {1, 1, 0, 0,},
+            {1, 1, 0, 0,},
+            {0, 0, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {1, 1, 0, 0,},
+            {1, 1, 0, 0,},
+            {0, 0, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {1, 1, 0, 0,},
+            {1, 1, 0, 0,},
+            {0, 0, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {1, 1, 0, 0,},
+            {1, 1, 0, 0,},
+            {0, 0, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+    },
+    /* S */
+    {
+        {
+            {0, 1, 1, 0,},
+            {1, 1, 0, 0,},
+            {0, 0, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {0, 1, 0, 0,},
+            {0, 1, 1, 0,},
+            {0, 0, 1, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {0, 0, 0, 0,},
+            {0, 1, 1, 0,},
+            {1, 1, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {1, 0, 0, 0,},
+            {1, 1, 0, 0,},
+            {0, 1, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+    },
+    /* T */
+    {
+        {
+            {0, 1, 0, 0,},
+            {1, 1, 1, 0,},
+            {0, 0, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {0, 1, 0, 0,},
+            {0, 1, 1, 0,},
+            {0, 1, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {0, 0, 0, 0,},
+            {1, 1, 1, 0,},
+            {0, 1, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {0, 1, 0, 0,},
+            {1, 1, 0, 0,},
+            {0, 1, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+    },
+    /* Z */
+    {
+        {
+            {1, 1, 0, 0,},
+            {0, 1, 1, 0,},
+            {0, 0, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {0, 0, 1, 0,},
+            {0, 1, 1, 0,},
+            {0, 1, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {0, 0, 0, 0,},
+            {1, 1, 0, 0,},
+            {0, 1, 1, 0,},
+            {0, 0, 0, 0,},
+        },
+        {
+            {0, 1, 0, 0,},
+            {1, 1, 0, 0,},
+            {1, 0, 0, 0,},
+            {0, 0, 0, 0,},
+        },
+    }
+};
+/* clang-format on */
+
+const int pieceOffsets[7][2] = {
+    {0, 0}, {-1, 0}, {-1, 0}, {0, 1}, {0, 0}, {0, 0}, {0, 0},
+};
+
+int max(int a, int b) { return a > b ? a : b; }
+int min(int a, int b) { return a < b ? a : b; }
+
+bool createPlayfield(Playfield *playfield, int width, int visibleHeight) {
+    playfield->width = width;
+    playfield->height = visibleHeight + 1;
+    playfield->cells = calloc((size_t)width * playfield->height, sizeof(int));
+    return playfield->cells != NULL;
+}
+
+void destroyPlayfield(Playfield *playfield) {
+    free(playfield->cells);
+    playfield->cells = NULL;
+}
+
+/* The 4x4 piece box can hang off the left edge or past the board, so loops
+ * over it are clamped to these */
+int getMinLeftBound(SDL_Rect pieceBounds) { return max(pieceBounds.x, 0); }
+
+int getMaxRightBound(SDL_Rect pieceBounds, const Playfield *playfield) {
+    return min(pieceBounds.x + pieceBounds.w, playfield->width);
+}
+
+int getMaxBottomBound(SDL_Rect pieceBounds, const Playfield *playfield) {
+    return min(pieceBounds.y + pieceBounds.h, playfield->height);
+}
+
+bool spawnRandomPiece(Playfield *playfield, SDL_Rect *pieceBounds,
+                      int *currentColor, int *pieceIndex) {
+    int(*grid)[playfield->width] = (int(*)[playfield->width])playfield->cells;
+    *pieceIndex = rand() % 7;
+
+    const int(*rotations)[4][4] = pieceRotations[*pieceIndex];
+
+    int rowOffset = pieceOffsets[*pieceIndex][0];
+    int columnOffset = pieceOffsets[*pieceIndex][1];
+    int spawnColumn = (playfield->width - 4) / 2; /* Centered, 3 on 10 wide */
+
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            int currentSquare = rotations[0][i][j];
+
+            if (currentSquare == 0) {
+                continue;
+            }
+
+            int *square =
+                &grid[i + rowOffset + 1][j + columnOffset + spawnColumn];
+            if (*square != 0) {
+                return false;
+            }
+            *square = CURRENT_PIECE_NUMBER;
+        }
+    }
+
+    *currentColor = *pieceIndex + 1;
+
+    pieceBounds->x = columnOffset + spawnColumn;
+    pieceBounds->y = rowOffset + 1;
+    pieceBounds->w = pieceBounds->h = 4;
+    return true;
+}
+
+KERNEL bool canMoveInDirectionKernel(const int width, SDL_Rect pieceBounds,
+                                     const Playfield *playfield,
+                                     enum Direction direction) {
+    int(*grid)[width] = (int(*)[width])playfield->cells;
+    int rowStep = direction == Direction_Down ? 1 : 0;
+    int columnStep = direction == Direction_Left    ? -1
+                     : direction == Direction_Right ? 1
+                                                    : 0;
+
+    int left = getMinLeftBound(pieceBounds);
+    int right = min(pieceBounds.x + pieceBounds.w, width);
+    int bottom = getMaxBottomBound(pieceBounds, playfield);
+
+    for (int i = pieceBounds.y; i < bottom; ++i) {
+        for (int j = left; j < right; ++j) {
+            if (grid[i][j] != CURRENT_PIECE_NUMBER) {
+                continue;
+            }
+
+            int row = i + rowStep;
+            int column = j + columnStep;
+            if (row == playfield->height || column < 0 || column == width) {
+                return false; /* Reached bottom or a wall */
+            }
+
+            if (grid[row][column] != CURRENT_PIECE_NUMBER &&
+                grid[row][column] != 0) { /* Collided with something */
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool canMoveInDirection(SDL_Rect pieceBounds, const Playfield *playfield,
+                        enum Direction direction) {
+    SPECIALIZE_ON_WIDTH(playfield->width,
+                        return canMoveInDirectionKernel(
+                            KERNEL_WIDTH, pieceBounds, playfield, direction));
+    return false;
+}
+
+bool canRotatePiece(SDL_Rect pieceBounds, const Playfield *playfield,
+                    int pieceIndex, int *currentRotation) {
+    const int(*rotations)[4][4] = pieceRotations[pieceIndex];
+
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            int rotationSquare = rotations[(*currentRotation + 1) % 4][i][j];
+            if (rotationSquare == 0) {
+                continue;
+            }
+            int playfieldRow = i + pieceBounds.y;
+            int playfieldColumn = j + pieceBounds.x;
+            if (playfieldRow >= playfield->height ||
+                playfieldColumn >= playfield->width || playfieldColumn < 0) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void dropPieceOneRow(SDL_Rect *pieceBounds, Playfield *playfield) {
+    dropPieceRows(pieceBounds, playfield, 1);
+}
+
+void dropPieceRows(SDL_Rect *pieceBounds, Playfield *playfield, int rows) {
+    int(*grid)[playfield->width] = (int(*)[playfield->width])playfield->cells;
+
+    if (rows <= 0) { /* Would erase the piece */
+        return;
+    }
+
+    /* Bottom up, so a square never lands on one that hasn't moved yet */
+    for (int i = getMaxBottomBound(*pieceBounds, playfield) - 1;
+         i >= pieceBounds->y; --i) {
+        for (int j = getMinLeftBound(*pieceBounds);
+             j < getMaxRightBound(*pieceBounds, playfield); ++j) {
+            if (grid[i][j] != CURRENT_PIECE_NUMBER) {
+                continue;
+            }
+            grid[i + rows][j] = grid[i][j];
+            grid[i][j] = 0;
+        }
+    }
+    pieceBounds->y += rows;
+}
+
+KERNEL int getDropDistanceKernel(const int width, SDL_Rect pieceBounds,
+                                 const Playfield *playfield) {
+    int(*grid)[width] = (int(*)[width])playfield->cells;
+    int distance = playfield->height;
+
+    for (int j = getMinLeftBound(pieceBounds);
+         j < min(pieceBounds.x + pieceBounds.w, width); ++j) {
+        /* Lowest square of the piece in this column */
+        int lowest = getMaxBottomBound(pieceBounds, playfield) - 1;
+        while (lowest >= pieceBounds.y &&
+               grid[lowest][j] != CURRENT_PIECE_NUMBER) {
+            --lowest;
+        }
+        if (lowest < pieceBounds.y) {
+            continue;
+        }
+
+        /* Walk down to whatever is under it, no further than we already know
+         * the piece can fall */
+        int row = lowest + 1;
+        while (row < playfield->height && row - lowest <= distance &&
+               grid[row][j] == 0) {
+            ++row;
+        }
+        distance = min(distance, row - lowest - 1);
+        if (distance == 0) {
+            break;
+        }
+    }
+
+    return distance;
+}
+
+int getDropDistance(SDL_Rect pieceBounds, const Playfield *playfield) {
+    SPECIALIZE_ON_WIDTH(
+        playfield->width,
+        return getDropDistanceKernel(KERNEL_WIDTH, pieceBounds, playfield));
+    return 0;
+}
+
+void movePieceLeft(SDL_Rect *pieceBounds, Playfield *playfield) {
+    int(*grid)[playfield->width] = (int(*)[playfield->width])playfield->cells;
+
+    for (int i = pieceBounds->y; i < getMaxBottomBound(*pieceBounds, playfield);
+         ++i) {
+        for (int j = getMinLeftBound(*pieceBounds);
+             j < getMaxRightBound(*pieceBounds, playfield); ++j) {
+            if (grid[i][j] != CURRENT_PIECE_NUMBER) {
+                continue;
+            }
+            grid[i][j - 1] = grid[i][j];
+            grid[i][j] = 0;
+        }
+    }
+    pieceBounds->x--;
+}
+
+void movePieceRight(SDL_Rect *pieceBounds, Playfield *playfield) {
+    int(*grid)[playfield->width] = (int(*)[playfield->width])playfield->cells;
+
+    for (int i = pieceBounds->y; i < getMaxBottomBound(*pieceBounds, playfield);
+         ++i) {
+        for (int j = getMaxRightBound(*pieceBounds, playfield) - 1;
+             j >= getMinLeftBound(*pieceBounds); --j) {
+            if (grid[i][j] != CURRENT_PIECE_NUMBER) {
+                continue;
+            }
+            grid[i][j + 1] = grid[i][j];
+            grid[i][j] = 0;
+        }
+    }
+    pieceBounds->x++;
+}
+
+void rotatePiece(SDL_Rect *pieceBounds, Playfield *playfield, int pieceIndex,
+                 int *currentRotation) {
+    int(*grid)[playfield->width] = (int(*)[playfield->width])playfield->cells;
+    const int(*rotations)[4][4] = pieceRotations[pieceIndex];
+
+    *currentRotation = (*currentRotation + 1) % 4;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            int rotationSquare = rotations[*currentRotation][i][j];
+            if (rotationSquare == 0) {
+                continue;
+            }
+            int playfieldRow = i + pieceBounds->y;
+            int playfieldColumn = j + pieceBounds->x;
+            grid[playfieldRow][playfieldColumn] =
+                10; /* Temporary value to erase all the old squares */
+        }
+    }
+
+    for (int i = pieceBounds->y; i < getMaxBottomBound(*pieceBounds, playfield);
+         ++i) {
+        for (int j = getMinLeftBound(*pieceBounds);
+             j < getMaxRightBound(*pieceBounds, playfield); ++j) {
+            if (grid[i][j] == CURRENT_PIECE_NUMBER) {
+                grid[i][j] = 0;
+            }
+            if (grid[i][j] == 10) {
+                grid[i][j] = CURRENT_PIECE_NUMBER;
+            }
+        }
+    }
+}
+
+void convertPieceToStatic(SDL_Rect pieceBounds, Playfield *playfield,
+                          int currentColor) {
+    int(*grid)[playfield->width] = (int(*)[playfield->width])playfield->cells;
+
+    for (int i = pieceBounds.y; i < getMaxBottomBound(pieceBounds, playfield);
+         ++i) {
+        for (int j = getMinLeftBound(pieceBounds);
+             j < getMaxRightBound(pieceBounds, playfield); ++j) {
+            if (grid[i][j] == CURRENT_PIECE_NUMBER) {
+                grid[i][j] = currentColor;
+            }
+        }
+    }
+}
+
+KERNEL int clearEmptyRowsKernel(const int width, Playfield *playfield) {
+    int(*grid)[width] = (int(*)[width])playfield->cells;
+    int rowsCleared = 0;
+    int emptyRows[4]; /* Can only clear up to 4 rows */
+
+    for (int i = 0; i < 4; ++i) {
+        emptyRows[i] = -1;
+    }
+
+    for (int i = 1; i < playfield->height && rowsCleared < 4; ++i) {
+        bool hasZero = false;
+        for (int j = 0; j < width; ++j) {
+            if (grid[i][j] == 0) {
+                hasZero = true;
+                break;
+            }
+        }
+        if (!hasZero) {
+            /* If the row has no zeros, clear it */
+            for (int j = 0; j < width; ++j) {
+                grid[i][j] = 0;
+            }
+
+            emptyRows[rowsCleared++] = i;
+        }
+    }
+
+    int offset = 0;
+    for (int i = rowsCleared - 1; i >= 0; --i) {
+        shiftAllRowsDown(playfield, emptyRows[i] + offset);
+        ++offset;
+    }
+
+    return rowsCleared;
+}
+
+int clearEmptyRows(Playfield *playfield) {
+    SPECIALIZE_ON_WIDTH(playfield->width,
+                        return clearEmptyRowsKernel(KERNEL_WIDTH, playfield));
+    return 0;
+}
+
+void shiftAllRowsDown(Playfield *playfield, int end) {
+    /* Rows are contiguous so rows 0..end-1 move down in one go */
+    memmove(&playfield->cells[playfield->width], playfield->cells,
+            (size_t)end * playfield->width * sizeof(int));
+}
+
+void buildGravityTable(double gravityTable[MAX_LEVEL + 1], int simulationRate) {
+    gravityTable[0] = 0; /* There's no level 0 */
+
+    for (int level = 1; level <= MAX_LEVEL; ++level) {
+        /* Seconds per row, the curve from the Tetris guideline */
+        double secondsPerRow = pow(0.8 - (level - 1) * 0.007, level - 1);
+        double rowsPerTick = 1 / (secondsPerRow * simulationRate);
+        double maxRowsPerTick = MAX_GRAVITY * 60 / simulationRate;
+        gravityTable[level] =
+            rowsPerTick < maxRowsPerTick ? rowsPerTick : maxRowsPerTick;
+    }
+}
+
+int levelForLinesCleared(int linesCleared) {
+    return min(1 + linesCleared / LINES_PER_LEVEL, MAX_LEVEL);
+}
+
+bool stepPieceFall(PieceFall *fall, SDL_Rect *pieceBounds,
+                   Playfield *playfield, double gravity, int lockDelayTicks) {
+    /* One landing check covers any number of rows, so 20G costs the same as
+     * level 1 */
+    int distance = getDropDistance(*pieceBounds, playfield);
+
+    fall->fallen += gravity;
+    int rows = min((int)fall->fallen, distance);
+    fall->fallen -= (int)fall->fallen;
+    if (rows > 0) {
+        dropPieceRows(pieceBounds, playfield, rows);
+        distance -= rows;
+    }
+
+    /* Getting further down than ever (like sliding off a ledge) starts the
+     * lock delay over, move resets and all, as in the guideline */
+    if (pieceBounds->y > fall->lowestRow) {
+        fall->lowestRow = pieceBounds->y;
+        fall->lockTicks = 0;
+        fall->lockResets = 0;
+    }
+
+    if (distance > 0) {
+        fall->state = LockState_Falling;
+        return false;
+    }
+
+    /* Resting on something, lock once the delay runs out */
+    fall->state = LockState_Locking;
+    fall->fallen = 0;
+    return ++fall->lockTicks >= lockDelayTicks;
+}
+
+void resetLockDelay(PieceFall *fall) {
+    /* Moving a resting piece buys it more time, but only so many times */
+    if (fall->state == LockState_Locking &&
+        fall->lockResets < MAX_LOCK_RESETS) {
+        fall->lockTicks = 0;
+        ++fall->lockResets;
+    }
+}
+
+int scoreForRowsCleared(int rowsCleared) {
+    switch (rowsCleared) {
+        case 1:
+            return 100;
+        case 2:
+            return 300;
+        case 3:
+            return 500;
+        case 4:
+            return 800;
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef TETRIS_H
+#define TETRIS_H
+
+/* Game rules, shared by the game and the tools. Nothing in here draws or
+ * touches SDL beyond SDL_Rect. */
+
+#include <SDL2/SDL_rect.h>
+#include <stdbool.h>
+
+#define PLAYFIELD_WIDTH 10
+#define PLAYFIELD_HEIGHT 25
+/* ^-- Default size, boards are sized at runtime now (see Playfield) */
+/* Height is 25 to allow for J and L to spawn correctly */
+
+/* Limits for --board, in visible rows (the hidden spawn row is extra) */
+static const int MIN_BOARD_WIDTH = 4;
+static const int MAX_BOARD_WIDTH = 64;
+static const int MIN_BOARD_HEIGHT = 4;
+static const int MAX_BOARD_HEIGHT = 1000;
+
+/* Levels and gravity, times are in 60Hz frames and get scaled to ticks */
+#define MAX_LEVEL 20 /* Sizes the gravity table */
+static const int LINES_PER_LEVEL = 10;
+static const double MAX_GRAVITY = 20;        /* Rows per frame, aka 20G */
+static const double SOFT_DROP_GRAVITY = 0.5; /* Rows per frame, down held */
+static const int LOCK_DELAY_FRAMES = 30;
+static const int MAX_LOCK_RESETS = 15;
+
+static const int CURRENT_PIECE_NUMBER = 9; /* Placeholder for current piece */
+
+/* Pieces */
+/* 0 = I, 1 = J, 2 = L, 3 = O, 4 = S, 5 = T, 6 = Z */
+
+enum Direction { Direction_Down, Direction_Left, Direction_Right };
+
+typedef struct {
+    int x;
+    int y;
+} Coord;
+
+/* Falling means there's room below the piece, Locking means it's resting on
+ * something and the lock delay is counting down */
+enum LockState { LockState_Falling, LockState_Locking };
+
+typedef struct {
+    enum LockState state;
+    double fallen;  /* Part of a row the piece has fallen, banked by gravity */
+    int lockTicks;  /* Ticks spent resting on something */
+    int lockResets; /* Moves/rotations that restarted the lock delay */
+    int lowestRow;  /* Furthest down the piece has been, as pieceBounds.y */
+} PieceFall;
+
+/* Row 0 is hidden (it's where pieces spawn), so the default board is 10x25
+ * with 24 rows on screen */
+typedef struct {
+    int width;
+    int height;
+    int *cells; /* Row major, height * width */
+} Playfield;
+
+/* Kernels are written once against a width parameter and stamped out here
+ * for the common widths, so the compiler sees a constant and can unroll the
+ * row loops. Everything else takes the generic path. */
+#define KERNEL static inline __attribute__((always_inline))
+#define SPECIALIZE_ON_WIDTH(width, statement) \
+    switch (width) {                          \
+        case 10: {                            \
+            const int KERNEL_WIDTH = 10;      \
+            statement;                        \
+        } break;                              \
+        case 16: {                            \
+            const int KERNEL_WIDTH = 16;      \
+            statement;                        \
+        } break;                              \
+        case 32: {                            \
+            const int KERNEL_WIDTH = 32;      \
+            statement;                        \
+        } break;                              \
+        case 64: {                            \
+            const int KERNEL_WIDTH = 64;      \
+            statement;                        \
+        } break;                              \
+        default: {                            \
+            const int KERNEL_WIDTH = (width); \
+            statement;                        \
+        } break;                              \
+    }
+
+extern const int pieceRotations[7][4][4][4];
+extern const int pieceOffsets[7][2];
+
+/* Utility */
+int max(int a, int b);
+int min(int a, int b);
+
+/* Actual game functions */
+bool createPlayfield(Playfield *playfield, int width, int visibleHeight);
+void destroyPlayfield(Playfield *playfield);
+int getMinLeftBound(SDL_Rect pieceBounds);
+int getMaxRightBound(SDL_Rect pieceBounds, const Playfield *playfield);
+int getMaxBottomBound(SDL_Rect pieceBounds, const Playfield *playfield);
+bool spawnRandomPiece(Playfield *playfield, SDL_Rect *pieceBounds,
+                      int *currentColor, int *pieceIndex);
+bool canMoveInDirection(SDL_Rect pieceBounds, const Playfield *playfield,
+                        enum Direction direction);
+bool canRotatePiece(SDL_Rect pieceBounds, const Playfield *playfield,
+                    int pieceIndex, int *currentRotation);
+void dropPieceOneRow(SDL_Rect *pieceBounds, Playfield *playfield);
+void dropPieceRows(SDL_Rect *pieceBounds, Playfield *playfield, int rows);
+int getDropDistance(SDL_Rect pieceBounds, const Playfield *playfield);
+void movePieceLeft(SDL_Rect *pieceBounds, Playfield *playfield);
+void movePieceRight(SDL_Rect *pieceBounds, Playfield *playfield);
+void rotatePiece(SDL_Rect *pieceBounds, Playfield *playfield, int pieceIndex,
+                 int *currentRotation);
+void convertPieceToStatic(SDL_Rect pieceBounds, Playfield *playfield,
+                          int currentColor);
+int clearEmptyRows(Playfield *playfield);
+void shiftAllRowsDown(Playfield *playfield, int end);
+int scoreForRowsCleared(int rowsCleared);
+
+/* Levels and gravity */
+void buildGravityTable(double gravityTable[MAX_LEVEL + 1], int simulationRate);
+int levelForLinesCleared(int linesCleared);
+bool stepPieceFall(PieceFall *fall, SDL_Rect *pieceBounds,
+                   Playfield *playfield, double gravity, int lockDelayTicks);
+void resetLockDelay(PieceFall *fall);
+
+#endif
@@ -0,0 +1,249 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "telemetry.h"
+
+/* Watches every running game through its telemetry segment, like top.
+ * Build with
+ *     clang -Wall -O3 top.c telemetry.c -o tetris-top
+ * and run alongside the games, nothing in them waits on us. Linux only: the
+ * games are found by listing /dev/shm, and other systems (macOS included)
+ * have no way to list shared memory segments. */
+#ifndef __linux__
+#error "tetris-top needs Linux to find the games' shared memory segments"
+#endif
+
+#define MAX_INSTANCES 256
+#define SHARED_MEMORY_DIR "/dev/shm"
+
+typedef struct {
+    int pid;
+    const TelemetrySegment *segment;
+    TelemetryData current;
+    TelemetryData previous; /* From the last refresh, for the rates */
+    bool hasPrevious;
+    bool seen; /* Still there on this refresh */
+} Instance;
+
+/* Per second, from the difference between two reads */
+typedef struct {
+    double ticks;
+    double frames;
+    double pieces;
+    double lines;
+} Rates;
+
+void attachInstances(Instance *instances, int *instanceCount);
+void detachInstance(Instance *instance);
+Rates ratesFor(const Instance *instance);
+uint64_t totalLines(const TelemetryData *data);
+void printInstances(Instance *instances, int instanceCount);
+
+int main(int argc, char *argv[]) {
+    double interval = 1;
+    bool once = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--interval") && i + 1 < argc) {
+            interval = atof(argv[++i]);
+            if (interval <= 0) {
+                printf("Interval has to be more than 0 seconds\n");
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--once")) {
+            once = true;
+        } else {
+            printf("Usage: %s [--interval SECONDS] [--once]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    Instance instances[MAX_INSTANCES];
+    int instanceCount = 0;
+
+    /* --once still needs two reads to work out rates */
+    attachInstances(instances, &instanceCount);
+    for (int i = 0; i < instanceCount; ++i) {
+        instances[i].previous = instances[i].current;
+        instances[i].hasPrevious = true;
+    }
+
+    struct timespec sleepTime = {(time_t)interval,
+                                 (long)((interval - (time_t)interval) * 1e9)};
+    while (true) {
+        nanosleep(&sleepTime, NULL);
+        attachInstances(instances, &instanceCount);
+
+        if (!once) {
+            /* Clear the screen and go back to the top */
+            printf("\033[H\033[2J");
+        }
+        printInstances(instances, instanceCount);
+        fflush(stdout);
+
+        if (once) {
+            break;
+        }
+        for (int i = 0; i < instanceCount; ++i) {
+            instances[i].previous = instances[i].current;
+            instances[i].hasPrevious = true;
+        }
+    }
+
+    for (int i = 0; i < instanceCount; ++i) {
+        detachInstance(&instances[i]);
+    }
+    return 0;
+}
+
+void attachInstances(Instance *instances, int *instanceCount) {
+    for (int i = 0; i < *instanceCount; ++i) {
+        instances[i].seen = false;
+    }
+
+    DIR *directory = opendir(SHARED_MEMORY_DIR);
+    struct dirent *entry;
+    while (directory && (entry = readdir(directory))) {
+        size_t prefixLength = strlen(TELEMETRY_PREFIX);
+        if (strncmp(entry->d_name, TELEMETRY_PREFIX, prefixLength)) {
+            continue;
+        }
+        int pid = atoi(entry->d_name + prefixLength);
+
+        Instance *instance = NULL;
+        for (int i = 0; i < *instanceCount; ++i) {
+            if (instances[i].pid == pid) {
+                instance = &instances[i];
+            }
+        }
+
+        /* Segments left behind by a game that crashed. A game run by
+         * another user can't be signalled (EPERM) but is still alive. */
+        if (pid <= 0 || (kill(pid, 0) < 0 && errno == ESRCH)) {
+            continue;
+        }
+
+        if (!instance) {
+            if (*instanceCount == MAX_INSTANCES) {
+                continue;
+            }
+
+            char name[sizeof(entry->d_name) + 1];
+            snprintf(name, sizeof(name), "/%s", entry->d_name);
+            int fd = shm_open(name, O_RDONLY, 0);
+            if (fd < 0) {
+                continue;
+            }
+            void *memory = mmap(NULL, sizeof(TelemetrySegment), PROT_READ,
+                                MAP_SHARED, fd, 0);
+            close(fd);
+            if (memory == MAP_FAILED) {
+                continue;
+            }
+
+            instance = &instances[(*instanceCount)++];
+            memset(instance, 0, sizeof(*instance));
+            instance->pid = pid;
+            instance->segment = memory;
+        }
+
+        /* A segment that's still being set up (or from another version)
+         * just doesn't show until it reads properly */
+        instance->seen = readTelemetry(instance->segment, &instance->current);
+    }
+    if (directory) {
+        closedir(directory);
+    }
+
+    /* Drop anything that went away, keeping the rest in order */
+    int kept = 0;
+    for (int i = 0; i < *instanceCount; ++i) {
+        if (instances[i].seen) {
+            instances[kept++] = instances[i];
+        } else {
+            detachInstance(&instances[i]);
+        }
+    }
+    *instanceCount = kept;
+}
+
+void detachInstance(Instance *instance) {
+    munmap((void *)instance->segment, sizeof(TelemetrySegment));
+    instance->segment = NULL;
+}
+
+Rates ratesFor(const Instance *instance) {
+    Rates rates = {0, 0, 0, 0};
+    const TelemetryData *now = &instance->current;
+    const TelemetryData *then = &instance->previous;
+    if (!instance->hasPrevious || now->publishedAt <= then->publishedAt) {
+        return rates;
+    }
+
+    double seconds = (now->publishedAt - then->publishedAt) / 1000.;
+    rates.ticks = (now->ticks - then->ticks) / seconds;
+    rates.frames = (now->frames - then->frames) / seconds;
+    rates.pieces = (now->piecesLocked - then->piecesLocked) / seconds;
+    rates.lines = (totalLines(now) - totalLines(then)) / seconds;
+    return rates;
+}
+
+uint64_t totalLines(const TelemetryData *data) {
+    uint64_t lines = 0;
+    for (int size = 1; size <= 4; ++size) {
+        lines += size * data->linesCleared[size];
+    }
+    return lines;
+}
+
+void printInstances(Instance *instances, int instanceCount) {
+    printf("%8s %-10s %6s %5s %9s %8s %8s %8s %14s %14s %s\n", "PID", "KIND",
+           "BOARDS", "LEVEL", "TICKS/s", "FPS", "PIECE/s", "LINE/s",
+           "FRAME p50/p99", "INPUT p50/p99", "1/2/3/4 LINES");
+
+    Rates total = {0, 0, 0, 0};
+    uint64_t totalClears[5] = {0};
+    int totalBoards = 0;
+    for (int i = 0; i < instanceCount; ++i) {
+        const Instance *instance = &instances[i];
+        const TelemetryData *data = &instance->current;
+        Rates rates = ratesFor(instance);
+
+        printf("%8d %-10.10s %6d %5d %9.1f %8.1f %8.2f %8.2f %6.2f/%-7.2f "
+               "%6.2f/%-7.2f %llu/%llu/%llu/%llu\n",
+               instance->pid, instance->segment->kind, data->boards,
+               data->level, rates.ticks, rates.frames, rates.pieces,
+               rates.lines, data->frameTimeP50, data->frameTimeP99,
+               data->inputLatencyP50, data->inputLatencyP99,
+               (unsigned long long)data->linesCleared[1],
+               (unsigned long long)data->linesCleared[2],
+               (unsigned long long)data->linesCleared[3],
+               (unsigned long long)data->linesCleared[4]);
+
+        total.ticks += rates.ticks;
+        total.frames += rates.frames;
+        total.pieces += rates.pieces;
+        total.lines += rates.lines;
+        totalBoards += data->boards;
+        for (int size = 0; size <= 4; ++size) {
+            totalClears[size] += data->linesCleared[size];
+        }
+    }
+
+    printf("%8s %-10d %6d %5s %9.1f %8.1f %8.2f %8.2f %14s %14s "
+           "%llu/%llu/%llu/%llu\n",
+           "TOTAL", instanceCount, totalBoards, "", total.ticks, total.frames,
+           total.pieces, total.lines, "", "",
+           (unsigned long long)totalClears[1],
+           (unsigned long long)totalClears[2],
+           (unsigned long long)totalClears[3],
+           (unsigned long long)totalClears[4]);
+}